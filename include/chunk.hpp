@@ -11,6 +11,11 @@
 
 #include "value.hpp"
 
+#define INLINE_CACHE_SIZE 4
+
+class ObjectClass;
+class ObjectClosure;
+
 enum OpCode {
   OP_CONSTANT,
   OP_NULL,
@@ -52,8 +57,24 @@ enum OpCode {
   OP_ARRAY,
   OP_ARRAY_SET,
   OP_ARRAY_GET,
+  OP_MAP,
   OP_DUPLICATE,
   OP_FIELD,
+  // number-only variants that the VM rewrites OP_GREATER..OP_MODULO into
+  // at runtime:
+  OP_GREATER_NUM,
+  OP_LESS_NUM,
+  OP_ADD_NUM,
+  OP_SUBSTRACT_NUM,
+  OP_MULTIPLY_NUM,
+  OP_DIVIDE_NUM,
+  OP_MODULO_NUM,
+  // built-in natives called by name, with the argument count as operand:
+  OP_SIZE,
+  OP_TYPEOF,
+  OP_IS_INTEGER,
+  OP_FLOOR,
+  OP_CEIL,
   OP_NOP
 };
 
@@ -63,28 +84,81 @@ enum AccessModifier {
   ACCESS_PUBLIC,
 };
 
-struct ByteCode {
-  uint8_t code;
-  const unsigned int line;
-  const std::string filename;
+// What a property access resolved to for instances of one class, valid as
+// long as the class's version is unchanged.
+struct CacheEntry {
+  const ObjectClass* objClass = nullptr;
+  uint32_t version = 0;
+  size_t slot = 0;                  // for fields
+  ObjectClosure* method = nullptr;  // for methods
+};
+
+// Polymorphic inline cache of an OP_GET_PROPERTY, OP_SET_PROPERTY or
+// OP_INVOKE site. Holds up to INLINE_CACHE_SIZE receiver classes and evicts
+// them round-robin.
+struct InlineCache {
+  CacheEntry entries[INLINE_CACHE_SIZE];
+  uint8_t next = 0;  // entry to fill next
+
+  const CacheEntry* find(const ObjectClass* objClass, uint32_t version) const {
+    for (const CacheEntry& entry : entries) {
+      if (entry.objClass == objClass && entry.version == version) {
+        return &entry;
+      }
+    }
+    return nullptr;
+  }
 
-  ByteCode(uint8_t code, unsigned int line, const std::string& filename);
+  void add(const CacheEntry& entry) {
+    entries[next] = entry;
+    next = (next + 1) % INLINE_CACHE_SIZE;
+  }
+};
+
+// Source position of a run of bytecode. Consecutive bytes emitted from the
+// same line of the same file share one entry.
+struct LineRun {
+  size_t start;  // index of the first byte of the run
+  unsigned int line;
+  size_t fileIndex;  // index into Chunk::filenames
 };
 
 class Chunk {
  private:
-  std::vector<ByteCode> bytecode;
+  std::vector<uint8_t> bytecode;
   std::vector<Value> constants;
+  std::vector<InlineCache> inlineCaches;
+
+  // only looked up for error reporting and disassembly:
+  std::vector<LineRun> lines;
+  std::vector<std::string> filenames;
+
+  const LineRun& getLineRunAt(size_t index) const;
 
  public:
   // bytecode vector getters and setters:
-  size_t getBytecodeSize() const;
-  ByteCode getBytecodeAt(size_t index) const;
-  void addBytecode(uint8_t byte, unsigned int line, std::string filename);
+  size_t getBytecodeSize() const { return bytecode.size(); }
+  uint8_t getBytecodeAt(size_t index) const { return bytecode[index]; }
+  uint8_t* getCode() { return bytecode.data(); }
+  void addBytecode(uint8_t byte, unsigned int line,
+                   const std::string& filename);
   void modifyCodeAt(uint8_t newCode, int index);
 
+  // source position of the byte at the given index:
+  unsigned int getLineAt(size_t index) const;
+  const std::string& getFilenameAt(size_t index) const;
+
   // constants vector getters and setters:
   size_t getConstantsSize() const;
   Value getConstantAt(size_t index) const;
+  const Value* getConstants() const { return constants.data(); }
+
+  // inline caches vector getters and setters:
+  size_t getInlineCachesSize() const { return inlineCaches.size(); }
+  const InlineCache& getInlineCacheAt(size_t index) const {
+    return inlineCaches[index];
+  }
+  InlineCache* getInlineCaches() { return inlineCaches.data(); }
+  size_t addInlineCache();  // returns the index in the vector
   size_t addConstant(Value value);  // returns the index in the vector
 };
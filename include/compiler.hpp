@@ -72,15 +72,14 @@ struct Upvalue {
 };
 
 struct GlobalVariables {
-  std::unordered_set<std::shared_ptr<ObjectString>, ObjectString::Hash,
+  std::unordered_set<ObjectString*, ObjectString::Hash,
                      ObjectString::Comparator>
       existingStrings;
-  std::unordered_set<std::shared_ptr<ObjectString>, ObjectString::Hash,
+  std::unordered_set<ObjectString*, ObjectString::Hash,
                      ObjectString::Comparator>
       tempStrings;
 
   bool contains(const std::string&) const;
-  std::shared_ptr<ObjectString> find(std::shared_ptr<ObjectString>);
   void migrate();
   void tempClear();
 };
@@ -103,11 +102,11 @@ class LocalVariables {
 enum FunctionType { TYPE_FUNCTION, TYPE_METHOD, TYPE_SCRIPT, TYPE_CONSTRUCTOR };
 
 struct FunctionInfo {
-  std::shared_ptr<ObjectFunction> const function;
+  ObjectFunction* const function;
   const FunctionType type;
   std::vector<Upvalue> upvalues;
 
-  FunctionInfo(std::shared_ptr<ObjectFunction> function, FunctionType type);
+  FunctionInfo(ObjectFunction* function, FunctionType type);
 };
 
 struct ClassInfo {
@@ -149,12 +148,19 @@ class Compiler {
   // returns the associated OpCode if the current token matches any, otherwise
   // returns 0
   OpCode matchBinaryEq();
+  // returns the opcode of the built-in native with the given name, otherwise
+  // returns 0
+  OpCode intrinsicOp(const Token* name);
 
   // returns the current chunk:
   Chunk& currentChunk();
 
   // add given byte to the current chunk
   void emitByte(uint8_t byte);
+  // add a new inline cache to the current chunk and emit its 16-bit index
+  void emitInlineCache();
+  // emit a variable get or set, with a 16-bit operand for globals
+  void emitVariable(uint8_t op, int index);
 
   // expression parsing functions:
   void expression();
@@ -179,6 +185,7 @@ class Compiler {
   void this_(bool canAssign);
   void super_(bool canAssign);
   void array(bool canAssign);
+  void map(bool canAssign);
   void index(bool canAssign);
 
   ParseRule* getRule(TokenType type);
@@ -190,7 +197,8 @@ class Compiler {
   void expressionStatement();
 
   // variable assignment and retrieval:
-  uint8_t identifierConstant(const Token* var);
+  // returns the index of the global variable with the given name
+  uint16_t globalIndex(const Token* var);
   void namedVariable(const Token* name, bool canAssign);
 
   // local variables:
@@ -233,10 +241,11 @@ class Compiler {
 
  public:
   void compile(const std::string& code, std::string currentFile);
-  std::shared_ptr<ObjectFunction> getFunction();
+  ObjectFunction* getFunction();
 
   void migrate();
   void tempClear();
+  void markRoots();
 
   Compiler();
 };
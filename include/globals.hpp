@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) Andy Yu and Yunze Zhou
+ * Luminous implementation code written by Yunze Zhou and Andy Yu.
+ * Sharing and altering of the source code is restricted under the MIT License.
+ */
+
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "object.hpp"
+
+// Names of every global variable, shared by the compiler and the VM. The
+// compiler resolves each global to a dense index once, and the VM keeps the
+// values in a vector laid out the same way.
+//
+// Indices are never reused: a name keeps its index even if the REPL drops it
+// after a failed line, so a value stored under it stays reachable by name.
+class GlobalTable {
+  std::unordered_map<ObjectString*, size_t, ObjectString::Hash,
+                     ObjectString::Comparator>
+      indices;
+  std::vector<ObjectString*> names;
+
+ public:
+  // returns the index of the given name, adding it if it is new
+  size_t indexOf(const std::string& name);
+  ObjectString* getName(size_t index) const;
+  size_t size() const;
+};
+
+extern GlobalTable globalTable;
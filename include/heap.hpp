@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) Andy Yu and Yunze Zhou
+ * Luminous implementation code written by Yunze Zhou and Andy Yu.
+ * Sharing and altering of the source code is restricted under the MIT License.
+ */
+
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "object.hpp"
+
+#define GC_HEAP_GROW_FACTOR 2
+#define GC_MIN_HEAP_SIZE (1024 * 1024)
+// a slice shorter than this fraction of its parent gets its own copy during
+// collection, so that it doesn't keep a much larger string alive
+#define SLICE_COMPACT_RATIO 4
+
+class Compiler;
+class VM;
+
+// Owns every object created by the compiler and the VM. Objects are linked
+// into an intrusive list on allocation and reclaimed by a tracing
+// mark-and-sweep collector.
+//
+// Allocation accounts for the new object, and containers report buffers they
+// reallocate later through adjust(). The collection itself runs at the VM's
+// safe points (loop back-edges and calls), where every live value is
+// reachable from the roots. This means the VM and natives never have to
+// protect temporaries in between two allocations.
+class Heap {
+  Object* objects = nullptr;  // head of linked list
+  std::vector<const Object*> grayStack;
+
+  // every live string, so that equal strings share one object. The table
+  // doesn't keep its strings alive, sweep drops the ones it frees.
+  std::unordered_set<ObjectString*, ObjectString::Hash,
+                     ObjectString::Comparator>
+      strings;
+
+  // roots:
+  VM* vm = nullptr;
+  Compiler* compiler = nullptr;
+
+  // for the heap-growth policy:
+  size_t bytesAllocated = 0;
+  size_t nextGC = GC_MIN_HEAP_SIZE;
+
+  // for --gc-stats:
+  size_t collections = 0;
+  size_t objectsFreed = 0;
+  size_t bytesFreed = 0;
+  size_t peakBytes = 0;
+  double gcSeconds = 0;
+
+  static size_t sizeOf(const Object* object);
+
+  void markRoots();
+  void blackenObject(const Object* object);
+  void traceReferences();
+  void sweep();
+
+ public:
+  template <typename T, typename... Args>
+  T* allocate(Args&&... args) {
+    T* object = new T(std::forward<Args>(args)...);
+    object->nextObject = objects;
+    objects = object;
+
+    bytesAllocated += sizeOf(object);
+    if (bytesAllocated > peakBytes) peakBytes = bytesAllocated;
+    return object;
+  }
+
+  // for an object whose buffers were reallocated after it was allocated
+  void adjust(size_t oldBytes, size_t newBytes) {
+    bytesAllocated = bytesAllocated + newBytes - oldBytes;
+    if (bytesAllocated > peakBytes) peakBytes = bytesAllocated;
+  }
+
+  // returns the string with the given contents, allocating it if needed
+  ObjectString* intern(std::string_view str);
+
+  bool shouldCollect() const {
+#ifdef STRESS_GC
+    return true;
+#else
+    return bytesAllocated > nextGC;
+#endif
+  }
+
+  void collectGarbage();
+  void markObject(const Object* object);
+  void markValue(Value value);
+
+  void setVM(VM* vm);
+  void setCompiler(Compiler* compiler);
+
+  void printStats() const;
+  void freeObjects();
+
+  ~Heap();
+};
+
+extern Heap heap;
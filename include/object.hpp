@@ -8,8 +8,9 @@
 
 #include <functional>
 #include <memory>
-#include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 #include "chunk.hpp"
@@ -31,25 +32,33 @@
 #define IS_STRING(value) \
   (IS_OBJECT(value) && OBJECT_TYPE(value) == OBJECT_STRING)
 #define IS_LIST(value) (IS_OBJECT(value) && OBJECT_TYPE(value) == OBJECT_LIST)
+#define IS_MAP(value) (IS_OBJECT(value) && OBJECT_TYPE(value) == OBJECT_MAP)
+#define IS_DEQUE(value) (IS_OBJECT(value) && OBJECT_TYPE(value) == OBJECT_DEQUE)
+#define IS_RANDOM(value) \
+  (IS_OBJECT(value) && OBJECT_TYPE(value) == OBJECT_RANDOM)
+#define IS_PRIORITY_QUEUE(value) \
+  (IS_OBJECT(value) && OBJECT_TYPE(value) == OBJECT_PRIORITY_QUEUE)
+#define IS_STRING_BUILDER(value) \
+  (IS_OBJECT(value) && OBJECT_TYPE(value) == OBJECT_STRING_BUILDER)
 
 #define AS_BOUND_METHOD(value) \
-  (std::static_pointer_cast<ObjectBoundMethod>(AS_OBJECT(value)))
-#define AS_CLASS(value) \
-  (std::static_pointer_cast<ObjectClass>(AS_OBJECT(value)))
-#define AS_CLOSURE(value) \
-  (std::static_pointer_cast<ObjectClosure>(AS_OBJECT(value)))
-#define AS_FUNCTION(value) \
-  (std::static_pointer_cast<ObjectFunction>(AS_OBJECT(value)))
-#define AS_INSTANCE(value) \
-  (std::static_pointer_cast<ObjectInstance>(AS_OBJECT(value)))
-#define AS_NATIVE(value) \
-  (std::static_pointer_cast<ObjectNative>(AS_OBJECT(value)))
-#define AS_OBJECTSTRING(value) \
-  (std::static_pointer_cast<ObjectString>(AS_OBJECT(value)))
+  (static_cast<ObjectBoundMethod*>(AS_OBJECT(value)))
+#define AS_CLASS(value) (static_cast<ObjectClass*>(AS_OBJECT(value)))
+#define AS_CLOSURE(value) (static_cast<ObjectClosure*>(AS_OBJECT(value)))
+#define AS_FUNCTION(value) (static_cast<ObjectFunction*>(AS_OBJECT(value)))
+#define AS_INSTANCE(value) (static_cast<ObjectInstance*>(AS_OBJECT(value)))
+#define AS_NATIVE(value) (static_cast<ObjectNative*>(AS_OBJECT(value)))
+#define AS_OBJECTSTRING(value) (static_cast<ObjectString*>(AS_OBJECT(value)))
 #define AS_STRING(value) \
-  ((std::static_pointer_cast<ObjectString>(AS_OBJECT(value)))->getString())
-#define AS_OBJECTLIST(value) \
-  (std::static_pointer_cast<ObjectList>(AS_OBJECT(value)))
+  ((static_cast<ObjectString*>(AS_OBJECT(value)))->getString())
+#define AS_OBJECTLIST(value) (static_cast<ObjectList*>(AS_OBJECT(value)))
+#define AS_OBJECTMAP(value) (static_cast<ObjectMap*>(AS_OBJECT(value)))
+#define AS_DEQUE(value) (static_cast<ObjectDeque*>(AS_OBJECT(value)))
+#define AS_RANDOM(value) (static_cast<ObjectRandom*>(AS_OBJECT(value)))
+#define AS_PRIORITY_QUEUE(value) \
+  (static_cast<ObjectPriorityQueue*>(AS_OBJECT(value)))
+#define AS_STRING_BUILDER(value) \
+  (static_cast<ObjectStringBuilder*>(AS_OBJECT(value)))
 
 enum ObjectType {
   OBJECT_BOUND_METHOD,
@@ -60,15 +69,25 @@ enum ObjectType {
   OBJECT_NATIVE,
   OBJECT_STRING,
   OBJECT_UPVALUE,
-  OBJECT_LIST
+  OBJECT_LIST,
+  OBJECT_MAP,
+  OBJECT_PRIORITY_QUEUE,
+  OBJECT_DEQUE,
+  OBJECT_RANDOM,
+  OBJECT_STRING_BUILDER
 };
 
 class Object {
+  friend class Heap;
+  Object* nextObject = nullptr;  // next object in the heap's linked list
+  mutable bool marked = false;   // reached during the current collection
+
  protected:
   const ObjectType type;
 
  public:
   Object(ObjectType type);
+  virtual ~Object() = default;
 
   // getters
   ObjectType getType() const;
@@ -76,67 +95,114 @@ class Object {
   void printObject() const;
 };
 
+// A string is either flat, a rope made by concatenating two long strings, or
+// a slice of a flat string. Ropes and slices only record where their
+// contents come from and are flattened the first time a std::string is
+// needed, after which they let go of their sources.
 class ObjectString : public Object {
-  const std::string str;
-  const size_t hash;
+  friend class Heap;
+  mutable std::string str;
+  mutable size_t hash = 0;
+  // halves of a rope, null once the string is flat
+  mutable const ObjectString* left = nullptr;
+  mutable const ObjectString* right = nullptr;
+  // the flat string a slice starts offset characters into, null once flat
+  mutable const ObjectString* parent = nullptr;
+  const size_t offset = 0;
+  const size_t length;
+  bool interned = false;  // set by the heap's intern table
+
+  void flatten() const;
 
  public:
-  ObjectString(const std::string& str);
+  ObjectString(std::string str);
+  ObjectString(const ObjectString* left, const ObjectString* right);
+  ObjectString(const ObjectString* parent, size_t offset, size_t length);
 
   // getters
-  const std::string& getString() const;
-  size_t getHash() const;
-
+  const std::string& getString() const;  // flattens a rope or a slice
+  size_t getHash() const;                // flattens a rope or a slice
+  // the contents without flattening a slice, a rope is still flattened
+  std::string_view getView() const;
+  size_t getLength() const;
+  bool isRope() const;
+  bool isSlice() const;
+  bool isInterned() const;
+  const ObjectString* getLeft() const;
+  const ObjectString* getRight() const;
+  const ObjectString* getParent() const;
+
+  // both accept a std::string_view as well, so that tables of strings can be
+  // searched without allocating a string first
   struct Hash {
-    size_t operator()(const std::shared_ptr<ObjectString>&) const;
+    using is_transparent = void;
+    size_t operator()(const ObjectString*) const;
+    size_t operator()(std::string_view) const;
   };
 
   struct Comparator {
-    bool operator()(const std::shared_ptr<ObjectString>& a,
-                    const std::shared_ptr<ObjectString>& b) const;
+    using is_transparent = void;
+    bool operator()(const ObjectString* a, const ObjectString* b) const;
+    bool operator()(std::string_view a, const ObjectString* b) const;
+    bool operator()(const ObjectString* a, std::string_view b) const;
   };
 };
 
 class ObjectFunction : public Object {
   int arity = 0;
   Chunk chunk;
-  std::shared_ptr<ObjectString> name;
+  ObjectString* name;
   int upvalueCount = 0;
+  // the most values a call's frame can hold at once, set by the compiler
+  size_t maxStack = 0;
 
  public:
-  ObjectFunction(std::shared_ptr<ObjectString> name);
+  ObjectFunction(ObjectString* name);
 
   // getters
-  const std::shared_ptr<ObjectString> getName() const;
+  ObjectString* getName() const;
   Chunk& getChunk();
   int getArity() const;
   int getUpvalueCount() const;
+  size_t getMaxStack() const;
 
   void increaseArity();
   void increateUpvalueCount();
+  void setMaxStack(size_t size);
   bool empty() const;
 };
 
-using NativeFn = std::function<Value(int, size_t)>;
+class VM;
+
+// Natives are plain functions. The arguments are a view into the VM stack,
+// and the VM checks their number against the arity before the call.
+using NativeFn = Value (*)(VM& vm, std::span<Value> args);
 class ObjectNative : public Object {
   const NativeFn function;
-  const std::shared_ptr<ObjectString> name;
+  const int minArity;
+  const int maxArity;
+  ObjectString* const name;
 
  public:
-  ObjectNative(const NativeFn function,
-               const std::shared_ptr<ObjectString> name);
+  // no call can pass more arguments than this
+  static constexpr int VARIADIC = UINT8_MAX;
+
+  ObjectNative(NativeFn function, int minArity, int maxArity,
+               ObjectString* name);
 
   // getters
-  NativeFn getFunction();
-  std::shared_ptr<ObjectString> getName();
+  NativeFn getFunction() const { return function; }
+  int getMinArity() const { return minArity; }
+  int getMaxArity() const { return maxArity; }
+  ObjectString* getName();
 };
 
 class ObjectUpvalue : public Object {
   const int locationIndex;
 
  public:
-  std::shared_ptr<ObjectUpvalue> next = nullptr;
-  std::optional<Value> closed;
+  ObjectUpvalue* next = nullptr;
+  Value closed;
   Value* location;
 
   ObjectUpvalue(int locationIndex, Value* location);
@@ -147,46 +213,70 @@ class ObjectUpvalue : public Object {
 };
 
 class ObjectClosure : public Object {
-  std::shared_ptr<ObjectFunction> function;
-  std::vector<std::shared_ptr<ObjectUpvalue>> upvalues;
+  ObjectFunction* function;
+  std::vector<ObjectUpvalue*> upvalues;
   int upvalueCount;
 
  public:
-  ObjectClosure(std::shared_ptr<ObjectFunction>);
+  ObjectClosure(ObjectFunction*);
 
   // getters
   size_t getUpvaluesSize() const;
-  std::shared_ptr<ObjectUpvalue> getUpvalue(int) const;
+  ObjectUpvalue* getUpvalue(int) const;
   int getUpvalueCount() const;
 
-  void setUpvalue(int, std::shared_ptr<ObjectUpvalue>);
-  void addUpvalue(std::shared_ptr<ObjectUpvalue>);
-  std::shared_ptr<ObjectFunction> getFunction();
+  void setUpvalue(int, ObjectUpvalue*);
+  void addUpvalue(ObjectUpvalue*);
+  ObjectFunction* getFunction();
 };
 
 class ObjectClass : public Object {
-  const ObjectString name;
-  std::unordered_map<std::shared_ptr<ObjectString>,
-                     std::pair<Value, AccessModifier>, ObjectString::Hash,
-                     ObjectString::Comparator>
-      methods;
-  std::unordered_map<std::shared_ptr<ObjectString>, AccessModifier,
+  ObjectString* const name;
+  std::unordered_map<ObjectString*, std::pair<Value, AccessModifier>,
                      ObjectString::Hash, ObjectString::Comparator>
+      methods;
+  std::unordered_map<ObjectString*, AccessModifier, ObjectString::Hash,
+                     ObjectString::Comparator>
       fields;
 
+  // Layout shared by every instance: maps a field name to its slot in
+  // ObjectInstance::fields. Declared fields come first; method names that an
+  // instance assigns to get a slot appended on demand.
+  std::unordered_map<ObjectString*, size_t, ObjectString::Hash,
+                     ObjectString::Comparator>
+      shape;
+  // initial slots of a new instance: null for declared fields, undefined for
+  // appended ones
+  std::vector<Value> defaultFields;
+  // changes whenever the shape or the methods change, which invalidates
+  // inline caches holding this class
+  uint32_t version = 0;
+
  public:
-  ObjectClass(const std::string& name);
+  ObjectClass(ObjectString* name);
 
   // getters
   const ObjectString& getName() const;
-  const AccessModifier* getAccessModifier(std::shared_ptr<ObjectString>) const;
-  const Value* getMethod(std::shared_ptr<ObjectString>) const;
-  const std::unordered_map<std::shared_ptr<ObjectString>, AccessModifier,
+  const AccessModifier* getAccessModifier(ObjectString*) const;
+  const Value* getMethod(ObjectString*) const;
+  const std::unordered_map<ObjectString*, std::pair<Value, AccessModifier>,
                            ObjectString::Hash, ObjectString::Comparator>&
+  getMethods() const;
+  const std::unordered_map<ObjectString*, AccessModifier, ObjectString::Hash,
+                           ObjectString::Comparator>&
   getFields() const;
-
-  void setField(std::shared_ptr<ObjectString>, AccessModifier);
-  void setMethod(std::shared_ptr<ObjectString>, Value, AccessModifier);
+  const std::unordered_map<ObjectString*, size_t, ObjectString::Hash,
+                           ObjectString::Comparator>&
+  getShape() const;
+  const std::vector<Value>& getDefaultFields() const;
+  // returns the slot of the given field, or -1 if it has none
+  int getSlot(ObjectString*) const;
+  // returns the slot of the given field, appending one if it has none
+  size_t addSlot(ObjectString*);
+  uint32_t getVersion() const { return version; }
+
+  void setField(ObjectString*, AccessModifier);
+  void setMethod(ObjectString*, Value, AccessModifier);
 
   // for inheritance
   void copyMethodsFrom(const ObjectClass& parent);
@@ -194,36 +284,33 @@ class ObjectClass : public Object {
 };
 
 class ObjectInstance : public Object {
-  const ObjectClass& instanceOf;
-  std::unordered_map<std::shared_ptr<ObjectString>, Value, ObjectString::Hash,
-                     ObjectString::Comparator>
-      fields;
+  ObjectClass* const instanceOf;
+  std::vector<Value> fields;  // indexed by the shape of instanceOf
 
  public:
-  ObjectInstance(const ObjectClass& instanceOf);
+  ObjectInstance(ObjectClass& instanceOf);
 
   const ObjectClass& getInstanceOf() const;
-  const Value* getField(std::shared_ptr<ObjectString> name) const;
-  void setField(std::shared_ptr<ObjectString> name, Value value);
-
-#ifdef DEBUG
-  std::unordered_map<std::shared_ptr<ObjectString>, Value, ObjectString::Hash,
-                     ObjectString::Comparator>&
-  getFields() {
-    return fields;
+  const Value* getField(ObjectString* name) const;
+  void setField(ObjectString* name, Value value);
+  // returns the field in the given slot, or nullptr if it is not set
+  Value* getFieldAt(size_t slot) {
+    if (slot >= fields.size() || IS_UNDEFINED(fields[slot])) return nullptr;
+    return &(fields[slot]);
   }
-#endif
+
+  const std::vector<Value>& getFields() const { return fields; }
 };
 
 class ObjectBoundMethod : public Object {
   const Value receiver;
-  std::shared_ptr<ObjectClosure> method;
+  ObjectClosure* method;
 
  public:
-  ObjectBoundMethod(Value receiver, std::shared_ptr<ObjectClosure> method);
+  ObjectBoundMethod(Value receiver, ObjectClosure* method);
 
   Value getReceiver() const;
-  std::shared_ptr<ObjectClosure> getMethod() const;
+  ObjectClosure* getMethod() const;
 };
 
 class ObjectList : public Object {
@@ -236,7 +323,144 @@ class ObjectList : public Object {
   void add(Value v);
   void set(Value v, int i);
   Value get(int i) const;
+  void insert(Value v, size_t i);
+  Value removeAt(size_t i);
 
   void printList() const;
   size_t size() const;
+  size_t getCapacity() const;
+};
+
+// A hash table from values to values. Entries are kept in insertion order,
+// and an open-addressing index with linear probing maps each key to its
+// entry. Removing a key leaves a tombstone in both until the next rebuild.
+class ObjectMap : public Object {
+ public:
+  struct Entry {
+    Value key;  // undefined once the entry has been removed
+    Value value;
+    size_t hash;
+  };
+
+ private:
+  static constexpr int32_t EMPTY = -1;
+  static constexpr int32_t DELETED = -2;
+
+  std::vector<Entry> entries;
+  std::vector<int32_t> indices;  // capacity is always a power of two
+  size_t count = 0;
+
+  static size_t hashValue(Value key);
+  // returns the position in indices holding the key, or the empty position
+  // where it would be added
+  size_t findIndex(Value key, size_t hash) const;
+  void rebuild(size_t capacity);
+
+ public:
+  ObjectMap();
+
+  // returns a pointer to the value of the key, or nullptr if it is missing
+  const Value* get(Value key) const;
+  void set(Value key, Value value);
+  // returns true if the key was present
+  bool remove(Value key, Value* removed);
+
+  // includes removed entries, whose keys are undefined
+  const std::vector<Entry>& getEntries() const;
+  size_t getCapacity() const;
+
+  void printMap() const;
+  size_t size() const;
+};
+
+// A binary min-heap of values, ordered by a key that is computed once when
+// the value is added. Keys are either all numbers or all strings.
+class ObjectPriorityQueue : public Object {
+ public:
+  struct Entry {
+    Value key;
+    Value value;
+  };
+
+ private:
+  std::vector<Entry> entries;
+
+  static bool less(Value a, Value b);
+
+ public:
+  ObjectPriorityQueue();
+
+  void push(Value key, Value value);
+  // both expect the queue to be non-empty
+  Value pop();
+  Value top() const;
+
+  const std::vector<Entry>& getEntries() const;
+  size_t size() const;
+};
+
+// A double-ended queue kept in a ring buffer that doubles when it is full.
+class ObjectDeque : public Object {
+  std::vector<Value> buffer;  // size is zero or a power of two
+  size_t head = 0;            // position of the first element
+  size_t count = 0;
+
+  void grow();
+
+ public:
+  ObjectDeque();
+
+  void pushBack(Value v);
+  void pushFront(Value v);
+  // both expect the deque to be non-empty
+  Value popBack();
+  Value popFront();
+
+  Value get(size_t i) const;
+  void set(Value v, size_t i);
+
+  void printDeque() const;
+  size_t size() const;
+  size_t getCapacity() const;
+};
+
+// A xoshiro256** pseudo-random number generator. The state is filled from the
+// seed with splitmix64, so any seed gives a well-mixed starting state.
+class ObjectRandom : public Object {
+  uint64_t state[4];
+
+ public:
+  ObjectRandom(uint64_t seed);
+
+  uint64_t next();
+  // uniform in [0, 1)
+  double nextDouble();
+  // uniform in [0, bound), bound must not be zero
+  uint64_t nextBelow(uint64_t bound);
+};
+
+// A buffer that strings and numbers are appended to in place. toString()
+// moves the buffer into a new string instead of copying it, and that string
+// holds the contents until the next append takes them back.
+class ObjectStringBuilder : public Object {
+  std::string buffer;
+  // the string holding the contents, null while they are in the buffer
+  ObjectString* built = nullptr;
+
+  // takes the contents back from the built string before they change
+  void reclaim();
+
+ public:
+  ObjectStringBuilder();
+
+  void append(std::string_view text);
+  void append(double number);
+  // moves the contents out, for the string that is to hold them
+  std::string release();
+  void setBuilt(ObjectString* string);
+
+  std::string_view getView() const;
+  size_t getLength() const;
+  size_t getCapacity() const;
+  ObjectString* getBuilt() const;
 };
\ No newline at end of file
@@ -30,6 +30,7 @@ enum TokenType {
   TOKEN_COMMA,
   TOKEN_DOT,
   TOKEN_SEMI,
+  TOKEN_COLON,
 
   // Single and double symbol tokens:
   TOKEN_LT,
@@ -6,42 +6,97 @@
 
 #pragma once
 
-#include <memory>
-#include <variant>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
 
 // actual -> Value
-#define BOOL_VAL(value) (Value(VAL_BOOL, value))
-#define NULL_VAL (Value(VAL_NULL, (double)0))
-#define NUM_VAL(value) (Value(VAL_NUM, value))
-#define OBJECT_VAL(value) (Value(VAL_OBJECT, value))
+#define BOOL_VAL(value) (Value::fromBool(value))
+#define NULL_VAL (Value())
+#define NUM_VAL(value) (Value::fromNum(value))
+#define OBJECT_VAL(value) (Value::fromObject(value))
+#define UNDEFINED_VAL (Value::undefined())
 
 // Value -> actual (no need for null)
-#define AS_BOOL(value) (std::get<bool>((value).getAs()))
-#define AS_NUM(value) (std::get<double>((value).getAs()))
-#define AS_OBJECT(value) (std::get<std::shared_ptr<Object>>((value).getAs()))
+#define AS_BOOL(value) ((value).asBool())
+#define AS_NUM(value) ((value).asNum())
+#define AS_OBJECT(value) ((value).asObject())
 
 // Type checks
-#define IS_BOOL(value) ((value).getType() == VAL_BOOL)
-#define IS_NULL(value) ((value).getType() == VAL_NULL)
-#define IS_NUM(value) ((value).getType() == VAL_NUM)
-#define IS_OBJECT(value) ((value).getType() == VAL_OBJECT)
+#define IS_BOOL(value) ((value).isBool())
+#define IS_NULL(value) ((value).isNull())
+#define IS_NUM(value) ((value).isNum())
+#define IS_OBJECT(value) ((value).isObject())
+#define IS_UNDEFINED(value) ((value).isUndefined())
+
+// room for the longest text formatNumber writes
+#define NUMBER_TEXT_MAX 32
 
 class Object;
 
 enum ValueType { VAL_BOOL, VAL_NULL, VAL_NUM, VAL_OBJECT };
 
+// A Value is a NaN-boxed 64-bit word. Any bit pattern that is not a quiet NaN
+// with the QNAN bits set is a double. Null and booleans are quiet NaNs with a
+// small tag in the low bits, and objects are quiet NaNs with the sign bit set
+// and the (48-bit) pointer stored in the low bits.
 class Value {
  private:
-  ValueType type;
-  std::variant<bool, double, std::shared_ptr<Object>> as;
+  static constexpr uint64_t SIGN_BIT = 0x8000000000000000;
+  static constexpr uint64_t QNAN = 0x7ffc000000000000;
+  static constexpr uint64_t TAG_NULL = 1;
+  static constexpr uint64_t TAG_FALSE = 2;
+  static constexpr uint64_t TAG_TRUE = 3;
+  static constexpr uint64_t TAG_UNDEFINED = 4;
+
+  uint64_t bits;
+
+  explicit constexpr Value(uint64_t bits) : bits{bits} {}
 
  public:
+  constexpr Value() : bits{QNAN | TAG_NULL} {}
+
+  static Value fromNum(double num) {
+    uint64_t bits;
+    std::memcpy(&bits, &num, sizeof(double));
+    return Value(bits);
+  }
+  static constexpr Value fromBool(bool b) {
+    return Value(QNAN | (b ? TAG_TRUE : TAG_FALSE));
+  }
+  static Value fromObject(const Object* object) {
+    return Value(SIGN_BIT | QNAN | (uint64_t)(uintptr_t)object);
+  }
+  // marks an empty slot inside the VM, never visible to scripts
+  static constexpr Value undefined() { return Value(QNAN | TAG_UNDEFINED); }
+
+  bool isNum() const { return (bits & QNAN) != QNAN; }
+  bool isNull() const { return bits == (QNAN | TAG_NULL); }
+  bool isBool() const { return (bits | 1) == (QNAN | TAG_TRUE); }
+  bool isObject() const {
+    return (bits & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT);
+  }
+  bool isUndefined() const { return bits == (QNAN | TAG_UNDEFINED); }
+
+  double asNum() const {
+    double num;
+    std::memcpy(&num, &bits, sizeof(double));
+    return num;
+  }
+  bool asBool() const { return bits == (QNAN | TAG_TRUE); }
+  Object* asObject() const {
+    return (Object*)(uintptr_t)(bits & ~(SIGN_BIT | QNAN));
+  }
+
   ValueType getType() const;
-  std::variant<bool, double, std::shared_ptr<Object>> getAs() const;
   bool operator==(const Value& compared) const;
-  Value& operator=(Value other);
   void printValue() const;
-
-  Value(ValueType type, std::variant<bool, double, std::shared_ptr<Object>> as);
-  Value(const Value& value);
 };
+
+// writes the shortest text that reads back as the same number, and returns its
+// length. Integers are written out in full. Every number the VM turns into
+// text goes through here.
+size_t formatNumber(double number, char* text);
+// returns false unless the whole text is a number
+bool parseNumber(std::string_view text, double& number);
@@ -6,89 +6,285 @@
 
 #pragma once
 #include <memory>
-#include <stack>
+#include <span>
+#include <streambuf>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
+#include "heap.hpp"
 #include "object.hpp"
 
+// Dispatch with a computed goto per opcode where the compiler supports
+// labels as values. Build with -DSWITCH_DISPATCH for the portable switch.
+#if defined(__GNUC__) && !defined(SWITCH_DISPATCH)
+#define COMPUTED_GOTO
+#endif
+
 #define FRAMES_MAX 256
+// every frame gets room for 256 locals plus as many temporaries
+#define STACK_MAX (FRAMES_MAX * 512)
+// concatenations at least this long build a rope instead of copying
+#define ROPE_MIN_LENGTH 128
+// substrings at least this long share their source's characters
+#define SLICE_MIN_LENGTH 128
+#define OUTPUT_BUFFER_SIZE (64 * 1024)
 
 class Chunk;
 class ObjectString;
 
 class VMException {};
 
-class MemoryStack : public std::stack<Value> {
+// Contiguous value stack with a fixed capacity. Slots never move once
+// allocated, so open upvalues can point straight into it.
+class MemoryStack {
+  std::unique_ptr<Value[]> values;
+  Value* stackTop;
+
+ public:
+  MemoryStack();
+
+  void push(Value value) { *stackTop++ = value; }
+  void pop() { stackTop--; }
+  // pops the top count values at once
+  void popN(size_t count) { stackTop -= count; }
+  // pushes a copy of the top count values
+  void duplicate(size_t count);
+  // drops every value from index onwards
+  void truncate(size_t index) { stackTop = values.get() + index; }
+  void reset() { stackTop = values.get(); }
+
+  Value& top() const { return stackTop[-1]; }
+  Value& peek(size_t distance) const { return stackTop[-1 - distance]; }
+  size_t size() const { return stackTop - values.get(); }
+  bool empty() const { return stackTop == values.get(); }
+
+  Value getValueAt(size_t index) const { return values[index]; }
+  Value* getValuePtrAt(size_t index) const { return &values[index]; }
+  void setValueAt(Value value, size_t index) { values[index] = value; }
+};
+
+// Collects everything written to std::cout in one large block and writes it
+// to stdout when the block is full or on flush, instead of once per line.
+class OutputBuffer : public std::streambuf {
+  std::unique_ptr<char[]> buffer;
+
+ protected:
+  int_type overflow(int_type c) override;
+  int sync() override;
+
  public:
-  Value getValueAt(size_t index) const;
-  Value* getValuePtrAt(size_t index) const;
-  void setValueAt(Value value, size_t index);
+  OutputBuffer();
 };
 
 struct CallFrame {
-  ObjectClosure& closure;
-  const size_t stackPos;
-  size_t PC;
+  ObjectClosure* closure;
+  uint8_t* ip;  // only up to date while the frame is not running
+  size_t stackPos;
 };
 
 class VM {
  private:
   MemoryStack memory;
-  std::stack<CallFrame> frames;
-  std::unordered_map<std::shared_ptr<ObjectString>, Value, ObjectString::Hash,
-                     ObjectString::Comparator>
-      globals;
-  std::shared_ptr<ObjectUpvalue> openUpvalues = nullptr;  // head of linked list
-  const std::shared_ptr<ObjectString> constructorString =
-      std::make_shared<ObjectString>("constructor");
+  OutputBuffer output;
+  std::streambuf* const stdoutBuffer;  // std::cout's buffer before the VM's
+  bool lineBuffered = false;
+  std::vector<CallFrame> frames;
+  // indexed like globalTable, undefined until the variable is assigned
+  std::vector<Value> globals;
+  ObjectUpvalue* openUpvalues = nullptr;  // head of linked list
+  ObjectString* const constructorString = heap.intern("constructor");
+
+  // the names returned by type(), interned once:
+  struct TypeNames {
+    ObjectString* const number = heap.intern("number");
+    ObjectString* const boolean = heap.intern("boolean");
+    ObjectString* const null = heap.intern("null");
+    ObjectString* const objClass = heap.intern("class");
+    ObjectString* const function = heap.intern("function");
+    ObjectString* const list = heap.intern("list");
+    ObjectString* const map = heap.intern("map");
+    ObjectString* const priorityQueue = heap.intern("priority queue");
+    ObjectString* const deque = heap.intern("deque");
+    ObjectString* const random = heap.intern("random generator");
+    ObjectString* const stringBuilder = heap.intern("string builder");
+    ObjectString* const string = heap.intern("string");
+    ObjectString* const unknown = heap.intern("unknown");
+  } typeNames;
+
+  // A native the compiler calls through its own opcode. The opcode does the
+  // native's work inline only while the native's global still holds it,
+  // otherwise it calls whatever the global holds.
+  struct Intrinsic {
+    size_t slot;
+    const Object* native;
+  };
+  Intrinsic sizeIntrinsic;
+  Intrinsic typeIntrinsic;
+  Intrinsic isIntegerIntrinsic;
+  Intrinsic floorIntrinsic;
+  Intrinsic ceilIntrinsic;
 
   void binaryOperation(char operation);
   void run();
   void runtimeError(const char* format, ...);
+  // prints the stack trace of the failed call frames
+  void unwindStack();
   void resetMemory();
   bool isFalsey(Value value) const;
-  void concatenate(const std::string& c, const std::string& d);
-  void concatenate(const std::string& c, double d);
-  Chunk& getTopChunk();
-
-  // read the next bytecode depending on situation:
-  uint8_t readByte();
-  Value readConstant();
-  uint16_t readShort();
+  // returns the index as a position in a list of the given size, or raises
+  // an error if it isn't one
+  size_t listIndex(Value index, size_t size);
+  void concatenate(ObjectString* left, ObjectString* right);
+  void concatenate(ObjectString* left, double right);
 
   // for calling functions:
   void callValue(Value callee, int argCount);
-  void call(std::shared_ptr<ObjectClosure> closure, int argCount);
+  void call(ObjectClosure* closure, int argCount);
+
+  // for intrinsics:
+  Intrinsic makeIntrinsic(const std::string& name);
+  bool isIntact(const Intrinsic& intrinsic) const {
+    Value value = globals[intrinsic.slot];
+    return IS_OBJECT(value) && AS_OBJECT(value) == intrinsic.native;
+  }
+  // calls the intrinsic's global with the argCount values on top of the stack
+  void callIntrinsicGlobal(const Intrinsic& intrinsic, int argCount);
+  const ObjectString* typeOf(Value value);
+  double lengthOf(Value value);
+  // returns value as a number, or raises an error for the native name
+  double numberArgument(const char* name, Value value);
 
   // for native functions:
-  void defineNative(std::string name, NativeFn function);
-  Value clockNative(int argCount, size_t start);
-  Value substringNative(int argCount, size_t start);
-  Value sizeNative(int argCount, size_t start);
-  Value floorNative(int argCount, size_t start);
-  Value ceilNative(int argCount, size_t start);
-  Value typeNative(int argCount, size_t start);
-  Value throwNative(int argCount, size_t start);
+  // reports a call to native with the wrong number of arguments
+  void nativeArityError(ObjectNative* native, int argCount);
+  static Value clockNative(VM& vm, std::span<Value> args);
+  static Value flushNative(VM& vm, std::span<Value> args);
+  static Value toStringNative(VM& vm, std::span<Value> args);
+  // returns what print shows for value
+  static std::string printedText(Value value);
+  static Value parseNumberNative(VM& vm, std::span<Value> args);
+  static Value substringNative(VM& vm, std::span<Value> args);
+  static Value sizeNative(VM& vm, std::span<Value> args);
+  static Value floorNative(VM& vm, std::span<Value> args);
+  static Value ceilNative(VM& vm, std::span<Value> args);
+  static Value isIntegerNative(VM& vm, std::span<Value> args);
+  static Value typeNative(VM& vm, std::span<Value> args);
+  static Value throwNative(VM& vm, std::span<Value> args);
+  static Value pushNative(VM& vm, std::span<Value> args);
+  static Value popNative(VM& vm, std::span<Value> args);
+  static Value insertNative(VM& vm, std::span<Value> args);
+  static Value removeAtNative(VM& vm, std::span<Value> args);
+  static Value keysNative(VM& vm, std::span<Value> args);
+  static Value valuesNative(VM& vm, std::span<Value> args);
+  static Value hasKeyNative(VM& vm, std::span<Value> args);
+  static Value removeNative(VM& vm, std::span<Value> args);
+  static Value priorityQueueNative(VM& vm, std::span<Value> args);
+  static Value heapPushNative(VM& vm, std::span<Value> args);
+  static Value heapPopNative(VM& vm, std::span<Value> args);
+  static Value heapTopNative(VM& vm, std::span<Value> args);
+  static Value dequeNative(VM& vm, std::span<Value> args);
+  static Value pushFrontNative(VM& vm, std::span<Value> args);
+  static Value popFrontNative(VM& vm, std::span<Value> args);
+
+  // for the math natives, defined in math.cpp:
+  void defineMathNatives();
+  // fills numbers from a list, returns false if an item isn't a number
+  static bool listToNumbers(Value list, std::vector<double>& numbers);
+  static Value numbersToList(const std::vector<double>& numbers);
+  // applies function to a number, or to every number of a list
+  template <typename Function>
+  Value mathNative(const char* name, Value arg, Function function);
+  static Value absNative(VM& vm, std::span<Value> args);
+  static Value sqrtNative(VM& vm, std::span<Value> args);
+  static Value expNative(VM& vm, std::span<Value> args);
+  static Value logNative(VM& vm, std::span<Value> args);
+  static Value sinNative(VM& vm, std::span<Value> args);
+  static Value cosNative(VM& vm, std::span<Value> args);
+  static Value tanNative(VM& vm, std::span<Value> args);
+  static Value asinNative(VM& vm, std::span<Value> args);
+  static Value acosNative(VM& vm, std::span<Value> args);
+  static Value atanNative(VM& vm, std::span<Value> args);
+  static Value powNative(VM& vm, std::span<Value> args);
+  Value extremumNative(const char* name, std::span<Value> args, bool isMax);
+  static Value minNative(VM& vm, std::span<Value> args);
+  static Value maxNative(VM& vm, std::span<Value> args);
+  static Value sumNative(VM& vm, std::span<Value> args);
+
+  // for the random natives, defined in random.cpp:
+  void defineRandomNatives();
+  // returns generator, or raises an error for the native name if it isn't one
+  ObjectRandom* randomArgument(const char* name, Value generator);
+  // checks the bounds of an integer range and returns its size
+  uint64_t rangeSize(const char* name, Value low, Value high);
+  static Value randomGeneratorNative(VM& vm, std::span<Value> args);
+  static Value nextIntNative(VM& vm, std::span<Value> args);
+  static Value nextFloatNative(VM& vm, std::span<Value> args);
+  static Value shuffleNative(VM& vm, std::span<Value> args);
+  static Value fillNative(VM& vm, std::span<Value> args);
+
+  // for the string natives, defined in string.cpp:
+  void defineStringNatives();
+  // returns the characters of source from begin up to end. Short substrings
+  // are copied, longer ones share the source's characters.
+  static ObjectString* substringOf(ObjectString* source, size_t begin,
+                                   size_t end);
+  // returns value as a string, or raises an error for the native name
+  ObjectString* stringArgument(const char* name, Value value);
+  // returns value as a non-negative integer, or raises an error
+  size_t countArgument(const char* name, Value value);
+  static Value indexOfNative(VM& vm, std::span<Value> args);
+  static Value lastIndexOfNative(VM& vm, std::span<Value> args);
+  static Value containsNative(VM& vm, std::span<Value> args);
+  static Value startsWithNative(VM& vm, std::span<Value> args);
+  static Value endsWithNative(VM& vm, std::span<Value> args);
+  static Value splitNative(VM& vm, std::span<Value> args);
+  static Value joinNative(VM& vm, std::span<Value> args);
+  static Value replaceNative(VM& vm, std::span<Value> args);
+  static Value trimNative(VM& vm, std::span<Value> args);
+  static Value toUpperNative(VM& vm, std::span<Value> args);
+  static Value toLowerNative(VM& vm, std::span<Value> args);
+  static Value repeatNative(VM& vm, std::span<Value> args);
+  // returns builder, or raises an error for the native name if it isn't one
+  ObjectStringBuilder* builderArgument(const char* name, Value builder);
+  // returns the builder's contents as a string, without copying them
+  static ObjectString* builtString(ObjectStringBuilder* builder);
+  static void appendValue(ObjectStringBuilder* builder, Value value);
+  static Value stringBuilderNative(VM& vm, std::span<Value> args);
+  static Value appendNative(VM& vm, std::span<Value> args);
+  static Value appendLineNative(VM& vm, std::span<Value> args);
 
   // for upvalues:
-  std::shared_ptr<ObjectUpvalue> captureUpvalue(Value* local, int localIndex);
+  ObjectUpvalue* captureUpvalue(Value* local, int localIndex);
   void closeUpvalues(int lastIndex);
 
   // for classes:
-  void defineField(std::shared_ptr<ObjectString> name);
-  void defineMethod(std::shared_ptr<ObjectString> name);
-  bool bindMethod(const ObjectClass& instanceOf,
-                  std::shared_ptr<ObjectString> name);
-  void invoke(std::shared_ptr<ObjectString> name, int argCount);
-  void invokeFromClass(const ObjectClass& instanceOf,
-                       std::shared_ptr<ObjectString> name, int argCount);
-  void validateAccessModifier(std::shared_ptr<ObjectString> name,
-                              ObjectClass& superclass);
-  void validateAccessModifier(std::shared_ptr<ObjectString> name,
+  void defineField(ObjectString* name, AccessModifier accessModifier);
+  void defineMethod(ObjectString* name, AccessModifier accessModifier);
+  bool bindMethod(const ObjectClass& instanceOf, ObjectString* name);
+  void invoke(ObjectString* name, ObjectString* className, int argCount,
+              InlineCache& cache);
+  // remembers what name resolves to on instances of instanceOf
+  void cacheProperty(InlineCache& cache, const ObjectClass& instanceOf,
+                     ObjectString* name);
+  void invokeFromClass(const ObjectClass& instanceOf, ObjectString* name,
+                       int argCount);
+  void validateAccessModifier(ObjectString* name, ObjectClass& superclass);
+  void validateAccessModifier(ObjectString* name, ObjectString* className,
                               ObjectInstance& instance);
 
  public:
-  void interpret(std::shared_ptr<ObjectFunction> function);
+  void interpret(ObjectFunction* function);
+  void markRoots();
+  // flushes the output after every print instead of when the buffer is full
+  void setLineBuffered(bool lineBuffered);
+
+  // makes function a global native taking exactly arity arguments, or
+  // between minArity and maxArity (ObjectNative::VARIADIC for no limit)
+  void defineNative(const std::string& name, NativeFn function, int arity);
+  void defineNative(const std::string& name, NativeFn function, int minArity,
+                    int maxArity);
+
   VM();
+  ~VM();
 };
@@ -6,19 +6,39 @@
 
 #include "chunk.hpp"
 
-ByteCode::ByteCode(uint8_t code, unsigned int line, const std::string& filename)
-    : code{code}, line{line}, filename{filename} {}
+#include <algorithm>
+
+void Chunk::addBytecode(uint8_t byte, unsigned int line,
+                        const std::string& filename) {
+  // a chunk only ever spans a handful of files, so a linear search is fine
+  if (lines.empty() || lines.back().line != line ||
+      filenames[lines.back().fileIndex] != filename) {
+    auto it = std::find(filenames.begin(), filenames.end(), filename);
+    size_t fileIndex = it - filenames.begin();
+    if (it == filenames.end()) filenames.push_back(filename);
+    lines.push_back(LineRun{bytecode.size(), line, fileIndex});
+  }
+  bytecode.push_back(byte);
+}
 
-size_t Chunk::getBytecodeSize() const { return bytecode.size(); }
+void Chunk::modifyCodeAt(uint8_t newCode, int index) {
+  bytecode[index] = newCode;
+}
 
-ByteCode Chunk::getBytecodeAt(size_t index) const { return bytecode[index]; }
+const LineRun& Chunk::getLineRunAt(size_t index) const {
+  // the last run starting at or before index
+  auto it = std::upper_bound(
+      lines.begin(), lines.end(), index,
+      [](size_t index, const LineRun& run) { return index < run.start; });
+  return *(it - 1);
+}
 
-void Chunk::addBytecode(uint8_t byte, unsigned int line, std::string filename) {
-  bytecode.emplace_back(byte, line, filename);
+unsigned int Chunk::getLineAt(size_t index) const {
+  return getLineRunAt(index).line;
 }
 
-void Chunk::modifyCodeAt(uint8_t newCode, int index) {
-  bytecode[index].code = newCode;
+const std::string& Chunk::getFilenameAt(size_t index) const {
+  return filenames[getLineRunAt(index).fileIndex];
 }
 
 size_t Chunk::getConstantsSize() const { return constants.size(); }
@@ -29,3 +49,8 @@ size_t Chunk::addConstant(Value value) {
   constants.emplace_back(value);
   return constants.size() - 1;
 }
+
+size_t Chunk::addInlineCache() {
+  inlineCaches.emplace_back();
+  return inlineCaches.size() - 1;
+}
@@ -6,15 +6,19 @@
 
 #include "compiler.hpp"
 
+#include <algorithm>
 #include <exception>
 
 #include "error.hpp"
+#include "globals.hpp"
+#include "heap.hpp"
 
 #ifdef DEBUG
 #include "debug.hpp"
 #endif
 
 Compiler::Compiler() : parser{Parser()}, scanner{Scanner()} {
+  heap.setCompiler(this);
   for (int tokenNum = TOKEN_LPAREN; tokenNum <= TOKEN_EOF; ++tokenNum) {
     TokenType curToken = (TokenType)tokenNum;
     switch (curToken) {
@@ -122,6 +126,10 @@ Compiler::Compiler() : parser{Parser()}, scanner{Scanner()} {
                                  std::bind(&Compiler::index, this, _1),
                                  PREC_CALL};
         break;
+      case TOKEN_LBRACE:
+        ruleMap[TOKEN_LBRACE] = {std::bind(&Compiler::map, this, _1), nullptr,
+                                 PREC_NONE};
+        break;
       default:
         ruleMap[curToken] = {nullptr, nullptr, PREC_NONE};
     }
@@ -147,7 +155,7 @@ void Compiler::compile(const std::string& code, std::string currentFile) {
 
   // emulate stack that will have script has bottom element and first frame
   functions.push_back(
-      FunctionInfo(std::make_shared<ObjectFunction>(nullptr), TYPE_SCRIPT));
+      FunctionInfo(heap.allocate<ObjectFunction>(nullptr), TYPE_SCRIPT));
   localVars.push_back(LocalVariables());
 
   std::shared_ptr<Local> script =
@@ -172,6 +180,18 @@ void Compiler::compile(const std::string& code, std::string currentFile) {
 void Compiler::migrate() { globalVars.migrate(); }
 void Compiler::tempClear() { globalVars.tempClear(); }
 
+void Compiler::markRoots() {
+  for (FunctionInfo& info : functions) {
+    heap.markObject(info.function);
+  }
+  for (ObjectString* name : globalVars.existingStrings) {
+    heap.markObject(name);
+  }
+  for (ObjectString* name : globalVars.tempStrings) {
+    heap.markObject(name);
+  }
+}
+
 void Compiler::consume(TokenType type, const std::string& message) {
   if (parser.current->type == type) {
     advance();
@@ -198,13 +218,180 @@ void Compiler::emitByte(uint8_t byte) {
 #endif
 }
 
-std::shared_ptr<ObjectFunction> Compiler::getFunction() {
-  std::shared_ptr<ObjectFunction> topFunc = functions.back().function;
+void Compiler::emitVariable(uint8_t op, int index) {
+  emitByte(op);
+  if (op == OP_GET_GLOBAL || op == OP_SET_GLOBAL) {
+    emitByte((index >> 8) & 0xff);
+  }
+  emitByte(index & 0xff);
+}
+
+void Compiler::emitInlineCache() {
+  size_t index = currentChunk().addInlineCache();
+  if (index > UINT16_MAX) {
+    error(parser.prev->line, "Too many property accesses in one function.",
+          parser.prev->file);
+  }
+
+  emitByte((index >> 8) & 0xff);
+  emitByte(index & 0xff);
+}
+
+// How one instruction moves the stack: it pops some values, then pushes
+// some, and may need extra slots while it runs.
+struct StackEffect {
+  size_t length;
+  int pops;
+  int pushes;
+  int extra = 0;
+};
+
+// Every opcode is listed without a default, so that -Wswitch points out a new
+// one that is missing here. Getting one wrong lets a frame outgrow the stack.
+static StackEffect stackEffect(const Chunk& chunk, size_t index) {
+  uint8_t operand = index + 1 < chunk.getBytecodeSize()
+                        ? chunk.getBytecodeAt(index + 1)
+                        : 0;
+  switch ((OpCode)chunk.getBytecodeAt(index)) {
+    case OP_CONSTANT:
+    case OP_GET_LOCAL:
+    case OP_GET_UPVALUE:
+    case OP_CLASS:
+      return {2, 0, 1};
+    case OP_NULL:
+    case OP_TRUE:
+    case OP_FALSE:
+      return {1, 0, 1};
+    case OP_GET_GLOBAL:
+      return {3, 0, 1};
+    case OP_SET_LOCAL:
+    case OP_SET_UPVALUE:
+      return {2, 0, 0};
+    case OP_SET_GLOBAL:
+    case OP_FIELD:
+    case OP_JUMP:
+    case OP_JUMP_IF_FALSE:
+    case OP_LOOP:
+      return {3, 0, 0};
+    case OP_POP:
+    case OP_PRINT:
+    case OP_CLOSE_UPVALUE:
+    case OP_INHERIT:
+      return {1, 1, 0};
+    case OP_METHOD:
+      return {3, 1, 0};
+    case OP_GET_PROPERTY:
+      return {5, 1, 1};
+    case OP_SET_PROPERTY:
+      return {5, 2, 1};
+    case OP_GET_SUPER:
+      return {3, 2, 1};
+    case OP_EQUAL:
+    case OP_GREATER:
+    case OP_LESS:
+    case OP_ADD:
+    case OP_SUBSTRACT:
+    case OP_MULTIPLY:
+    case OP_DIVIDE:
+    case OP_MODULO:
+    case OP_GREATER_NUM:
+    case OP_LESS_NUM:
+    case OP_ADD_NUM:
+    case OP_SUBSTRACT_NUM:
+    case OP_MULTIPLY_NUM:
+    case OP_DIVIDE_NUM:
+    case OP_MODULO_NUM:
+    case OP_ARRAY_GET:
+      return {1, 2, 1};
+    case OP_ARRAY_SET:
+      return {1, 3, 1};
+    case OP_NOT:
+    case OP_NEGATE:
+      return {1, 1, 1};
+    case OP_CALL:
+      return {2, operand + 1, 1};
+    case OP_INVOKE:
+      return {6, chunk.getBytecodeAt(index + 2) + 1, 1};
+    case OP_SUPER_INVOKE:
+      return {4, chunk.getBytecodeAt(index + 2) + 2, 1};
+    case OP_CLOSURE: {
+      ObjectFunction* function = AS_FUNCTION(chunk.getConstantAt(operand));
+      return {2 + 2 * (size_t)function->getUpvalueCount(), 0, 1};
+    }
+    case OP_ARRAY:
+      return {2, operand, 1};
+    case OP_MAP:
+      return {2, 2 * operand, 1};
+    case OP_DUPLICATE:
+      return {2, 0, operand};
+    // an intrinsic whose global was replaced pushes the callee below its
+    // arguments
+    case OP_SIZE:
+    case OP_TYPEOF:
+    case OP_IS_INTEGER:
+    case OP_FLOOR:
+    case OP_CEIL:
+      return {2, operand, 1, 1};
+    case OP_RETURN:
+      return {1, 1, 0};
+    case OP_NOP:
+      return {1, 0, 0};
+  }
+  return {1, 0, 0};  // unreachable
+}
+
+// returns the most values the chunk's code can have on the stack at once,
+// starting from base values, by following every path through the code
+static size_t maxStackDepth(const Chunk& chunk, size_t base) {
+  size_t size = chunk.getBytecodeSize();
+  // deepest stack seen on entry to each instruction, -1 if not reached
+  std::vector<int> depths(size, -1);
+  std::vector<size_t> pending;
+  if (size > 0) {
+    depths[0] = base;
+    pending.push_back(0);
+  }
+
+  // a path can only deepen the stack by one value per byte, the limit keeps
+  // a loop that leaves values behind from being followed forever
+  int limit = base + size;
+  int maxDepth = base;
+  while (!pending.empty()) {
+    size_t index = pending.back();
+    pending.pop_back();
+    uint8_t op = chunk.getBytecodeAt(index);
+    StackEffect effect = stackEffect(chunk, index);
+    int depth = depths[index];
+    int next = std::clamp(depth - effect.pops + effect.pushes, 0, limit);
+    maxDepth = std::max({maxDepth, depth + effect.extra, next});
+
+    std::vector<size_t> successors;
+    if (op == OP_JUMP || op == OP_JUMP_IF_FALSE || op == OP_LOOP) {
+      size_t offset = (chunk.getBytecodeAt(index + 1) << 8) |
+                      chunk.getBytecodeAt(index + 2);
+      successors.push_back(op == OP_LOOP ? index + 3 - offset
+                                         : index + 3 + offset);
+    }
+    if (op != OP_JUMP && op != OP_LOOP && op != OP_RETURN) {
+      successors.push_back(index + effect.length);
+    }
+    for (size_t successor : successors) {
+      if (successor < size && depths[successor] < next) {
+        depths[successor] = next;
+        pending.push_back(successor);
+      }
+    }
+  }
+  return maxDepth;
+}
+
+ObjectFunction* Compiler::getFunction() {
+  ObjectFunction* topFunc = functions.back().function;
   Chunk& topFuncChunk = topFunc->getChunk();
 
   // if the function doesn't have a return statement at the end
   if (topFuncChunk.getBytecodeSize() > 0 &&
-      topFuncChunk.getBytecodeAt(topFuncChunk.getBytecodeSize() - 1).code !=
+      topFuncChunk.getBytecodeAt(topFuncChunk.getBytecodeSize() - 1) !=
           OP_RETURN) {
     if (functions.back().type == TYPE_CONSTRUCTOR) {
       emitByte(OP_GET_LOCAL);
@@ -214,6 +401,8 @@ std::shared_ptr<ObjectFunction> Compiler::getFunction() {
     }
     emitByte(OP_RETURN);
   }
+  // the frame starts with the callee and its arguments
+  topFunc->setMaxStack(maxStackDepth(topFuncChunk, 1 + topFunc->getArity()));
 
   functions.pop_back();
   localVars.pop_back();
@@ -259,6 +448,21 @@ OpCode Compiler::matchBinaryEq() {
   return (OpCode)0;
 }
 
+OpCode Compiler::intrinsicOp(const Token* name) {
+  if (name->lexeme == "size") {
+    return OP_SIZE;
+  } else if (name->lexeme == "type") {
+    return OP_TYPEOF;
+  } else if (name->lexeme == "isInteger") {
+    return OP_IS_INTEGER;
+  } else if (name->lexeme == "floor") {
+    return OP_FLOOR;
+  } else if (name->lexeme == "ceil") {
+    return OP_CEIL;
+  }
+  return (OpCode)0;
+}
+
 uint8_t Compiler::makeConstant(Value value) {
   size_t constant = currentChunk().addConstant(value);
   if (constant > UINT8_MAX) {
@@ -291,7 +495,10 @@ void Compiler::call(bool canAssign) {
 
 void Compiler::number(bool canAssign) {
   (void)canAssign;
-  double number = std::stod(parser.prev->lexeme);
+  double number = 0;
+  if (!parseNumber(parser.prev->lexeme, number)) {
+    error(parser.prev->line, "Number literal out of range.", parser.prev->file);
+  }
   emitByte(OP_CONSTANT);
   emitByte(makeConstant(NUM_VAL(number)));
 }
@@ -393,8 +600,7 @@ ParseRule* Compiler::getRule(TokenType type) { return &ruleMap[type]; }
 void Compiler::string(bool canAssign) {
   (void)canAssign;
   emitByte(OP_CONSTANT);
-  emitByte(makeConstant(
-      OBJECT_VAL(std::make_shared<ObjectString>(parser.prev->lexeme))));
+  emitByte(makeConstant(OBJECT_VAL(heap.intern(parser.prev->lexeme))));
 }
 
 void Compiler::functionDeclaration() {
@@ -408,11 +614,10 @@ void Compiler::functionDeclaration() {
           parser.prev->file);
   }
 
-  uint8_t global = identifierConstant(parser.prev);
+  uint16_t global = globalIndex(parser.prev);
   markInitialized();
   function(TYPE_FUNCTION);
-  emitByte(OP_SET_GLOBAL);
-  emitByte(global);
+  emitVariable(OP_SET_GLOBAL, global);
   emitByte(OP_POP);
 }
 
@@ -420,9 +625,8 @@ void Compiler::function(FunctionType type) {
   beginScope();
 
   // push new function on stack:
-  std::shared_ptr<ObjectFunction> objectFunction =
-      std::make_shared<ObjectFunction>(
-          std::make_shared<ObjectString>(parser.prev->lexeme));
+  ObjectFunction* objectFunction =
+      heap.allocate<ObjectFunction>(heap.intern(parser.prev->lexeme));
   functions.push_back(FunctionInfo(objectFunction, type));
 
   localVars.push_back(LocalVariables());
@@ -461,7 +665,7 @@ void Compiler::function(FunctionType type) {
   // Create function object:
   endScope();
   std::vector<Upvalue> upvalues(functions.back().upvalues);
-  std::shared_ptr<ObjectFunction> newFunction = getFunction();
+  ObjectFunction* newFunction = getFunction();
   emitByte(OP_CLOSURE);
   emitByte(makeConstant(OBJECT_VAL(newFunction)));
 
@@ -590,6 +794,27 @@ void Compiler::array(bool canAssign) {
   emitByte(itemCount);
 }
 
+void Compiler::map(bool canAssign) {
+  (void)canAssign;
+  uint8_t pairCount = 0;
+  if (parser.current->type != TOKEN_RBRACE) {
+    do {
+      expression();
+      consume(TOKEN_COLON, "Expect ':' after map key.");
+      expression();
+      if (pairCount == UINT8_MAX) {
+        error(parser.prev->line, "Too many entries in map literal.",
+              parser.prev->file);
+      }
+      pairCount++;
+    } while (match(TOKEN_COMMA));
+  }
+
+  consume(TOKEN_RBRACE, "Expect '}' to close map.");
+  emitByte(OP_MAP);
+  emitByte(pairCount);
+}
+
 void Compiler::block() {
   while (!(parser.current->type == TOKEN_RBRACE) &&
          !(parser.current->type == TOKEN_EOF)) {
@@ -608,11 +833,12 @@ void Compiler::printStatement() {
 }
 
 void Compiler::expressionStatement() {
-  bool pop = scopeDepth == 0 || inLocalVars(*(parser.current)) ||
-             globalVars.contains(parser.current->lexeme);
+  // an assignment that declares a local leaves its value on the stack as the
+  // local's slot, any other statement's value is discarded
+  size_t localCount = localVars.back().size();
   expression();
   consume(TOKEN_SEMI, "Expect ';' after statement.");
-  if (pop) {
+  if (localVars.back().size() == localCount) {
     emitByte(OP_POP);
   }
 }
@@ -702,7 +928,7 @@ void Compiler::forStatement() {
     if (!inGlobal) {
       index = resolveLocal(varName, functions.size() - 1);
     } else {
-      index = identifierConstant(varName);
+      index = globalIndex(varName);
     }
   }
 
@@ -714,14 +940,18 @@ void Compiler::forStatement() {
   }
 
   // set the value on the stack, we already have the index
+  uint8_t getOp, setOp;
   if (isUpvalue) {
-    emitByte(OP_SET_UPVALUE);
+    getOp = OP_GET_UPVALUE;
+    setOp = OP_SET_UPVALUE;
   } else if (!inGlobal) {
-    emitByte(OP_SET_LOCAL);
+    getOp = OP_GET_LOCAL;
+    setOp = OP_SET_LOCAL;
   } else {
-    emitByte(OP_SET_GLOBAL);
+    getOp = OP_GET_GLOBAL;
+    setOp = OP_SET_GLOBAL;
   }
-  emitByte((uint8_t)index);
+  emitVariable(setOp, index);
 
   // pop from the stack if it was already declared before
   if (inLocal || inGlobal) {
@@ -735,14 +965,7 @@ void Compiler::forStatement() {
   consume(TOKEN_TO, "Expect 'to' delimiter in for loop declaration.");
 
   // get the value of variable and the expression it's being compared to
-  if (isUpvalue) {
-    emitByte(OP_GET_UPVALUE);
-  } else if (!inGlobal) {
-    emitByte(OP_GET_LOCAL);
-  } else {
-    emitByte(OP_GET_GLOBAL);
-  }
-  emitByte((uint8_t)index);
+  emitVariable(getOp, index);
   expression();
 
   consume(TOKEN_BY,
@@ -753,7 +976,10 @@ void Compiler::forStatement() {
 
   consume(TOKEN_NUM, "Expect a numerical incrementor in for loop declaration.");
   const Token* inc = parser.prev;
-  double numInc = std::stod(inc->lexeme);
+  double numInc = 0;
+  if (!parseNumber(inc->lexeme, numInc)) {
+    error(inc->line, "Number literal out of range.", inc->file);
+  }
 
   // emit based on negative or not
   if (negativeInc) {
@@ -773,28 +999,14 @@ void Compiler::forStatement() {
 
   int incrementStart = currentChunk().getBytecodeSize();
 
-  if (isUpvalue) {
-    emitByte(OP_GET_UPVALUE);
-  } else if (!inGlobal) {
-    emitByte(OP_GET_LOCAL);
-  } else {
-    emitByte(OP_GET_GLOBAL);
-  }
-  emitByte((uint8_t)index);
+  emitVariable(getOp, index);
   emitByte(OP_CONSTANT);
   emitByte(makeConstant(NUM_VAL(numInc)));
   if (negativeInc) {
     emitByte(OP_NEGATE);
   }
   emitByte(OP_ADD);
-  if (isUpvalue) {
-    emitByte(OP_SET_UPVALUE);
-  } else if (!inGlobal) {
-    emitByte(OP_SET_LOCAL);
-  } else {
-    emitByte(OP_SET_GLOBAL);
-  }
-  emitByte((uint8_t)index);
+  emitVariable(setOp, index);
 
   // don't need the expression after it is incremented anymore
   emitByte(OP_POP);
@@ -928,14 +1140,16 @@ void Compiler::synchronize() {
   }
 }
 
-uint8_t Compiler::identifierConstant(const Token* var) {
-  std::shared_ptr<ObjectString> ptr =
-      std::make_shared<ObjectString>(var->lexeme);
+uint16_t Compiler::globalIndex(const Token* var) {
+  size_t index = globalTable.indexOf(var->lexeme);
+  if (index > UINT16_MAX) {
+    error(var->line, "Too many global variables.", var->file);
+  }
+
   if (!globalVars.contains(var->lexeme)) {
-    globalVars.tempStrings.insert(ptr);
-    return makeConstant(OBJECT_VAL(ptr));
+    globalVars.tempStrings.insert(globalTable.getName(index));
   }
-  return makeConstant(OBJECT_VAL(globalVars.find(ptr)));
+  return (uint16_t)index;
 }
 
 void Compiler::markInitialized() {
@@ -996,9 +1210,19 @@ void Compiler::namedVariable(const Token* name, bool canAssign) {
     getOp = OP_GET_UPVALUE;
     setOp = OP_SET_UPVALUE;
   } else {
-    arg = identifierConstant(name);
+    arg = globalIndex(name);
     getOp = OP_GET_GLOBAL;
     setOp = OP_SET_GLOBAL;
+
+    // calling a built-in by name skips the global lookup, the VM still
+    // calls the global if it has been replaced since
+    OpCode intrinsic = intrinsicOp(name);
+    if (intrinsic && match(TOKEN_LPAREN)) {
+      uint8_t argCount = argumentList();
+      emitByte(intrinsic);
+      emitByte(argCount);
+      return;
+    }
   }
 
   OpCode binaryOpCode = matchBinaryEq();
@@ -1008,8 +1232,7 @@ void Compiler::namedVariable(const Token* name, bool canAssign) {
         error(name->line, "Can't read local variable in its own initializer.",
               name->file);
       }
-      emitByte(getOp);
-      emitByte((uint8_t)arg);
+      emitVariable(getOp, arg);
     }
     expression();
     if (binaryOpCode) {
@@ -1019,16 +1242,15 @@ void Compiler::namedVariable(const Token* name, bool canAssign) {
     if (localVars.back().size() > 0 && localVars.back().back()->depth == -1) {
       markInitialized();
     }
-    emitByte(setOp);
+    emitVariable(setOp, arg);
   } else {
     // if local var and not initialized (self-use initialization):
     if (getOp == OP_GET_LOCAL && localVars.back().at(arg)->depth == -1) {
       error(name->line, "Can't read local variable in its own initializer.",
             name->file);
     }
-    emitByte(getOp);
+    emitVariable(getOp, arg);
   }
-  emitByte((uint8_t)arg);
 }
 
 Local::Local(const Token name, int depth) : name{name}, depth{depth} {}
@@ -1051,15 +1273,8 @@ bool Compiler::inLocalVars(const Token& token) {
 }
 
 bool GlobalVariables::contains(const std::string& name) const {
-  std::shared_ptr<ObjectString> target = std::make_shared<ObjectString>(name);
-  return existingStrings.contains(target) || tempStrings.contains(target);
-}
-
-std::shared_ptr<ObjectString> GlobalVariables::find(
-    std::shared_ptr<ObjectString> target) {
-  auto it = existingStrings.find(target);
-  auto it2 = tempStrings.find(target);
-  return it == existingStrings.end() ? *(it2) : *(it);
+  return existingStrings.contains(std::string_view(name)) ||
+         tempStrings.contains(std::string_view(name));
 }
 
 void GlobalVariables::migrate() {
@@ -1114,7 +1329,7 @@ int Compiler::resolveUpvalue(const Token* name, size_t functionIndex) {
   return -1;
 }
 
-FunctionInfo::FunctionInfo(std::shared_ptr<ObjectFunction> function,
+FunctionInfo::FunctionInfo(ObjectFunction* function,
                            FunctionType type)
     : function{function}, type{type} {}
 
@@ -1152,11 +1367,10 @@ void Compiler::classDeclaration() {
 
   // define the class as a global var
   const Token* className = parser.prev;
-  uint8_t global = identifierConstant(className);
+  uint16_t global = globalIndex(className);
   emitByte(OP_CLASS);
-  emitByte(global);
-  emitByte(OP_SET_GLOBAL);
-  emitByte(global);
+  emitByte(makeConstant(OBJECT_VAL(globalTable.getName(global))));
+  emitVariable(OP_SET_GLOBAL, global);
   emitByte(OP_POP);
 
   if (match(TOKEN_INHERITS)) {
@@ -1233,8 +1447,7 @@ Token Compiler::syntheticToken(const std::string lexeme) {
 void Compiler::field(const Token* name, AccessModifier am) {
   // already checked for semi in classDeclaration
   advance();
-  uint8_t constant =
-      makeConstant(OBJECT_VAL(std::make_shared<ObjectString>(name->lexeme)));
+  uint8_t constant = makeConstant(OBJECT_VAL(heap.intern(name->lexeme)));
 
   emitByte(OP_FIELD);
   emitByte(constant);
@@ -1242,8 +1455,7 @@ void Compiler::field(const Token* name, AccessModifier am) {
 }
 
 void Compiler::method(const Token* name, AccessModifier am) {
-  uint8_t constant =
-      makeConstant(OBJECT_VAL(std::make_shared<ObjectString>(name->lexeme)));
+  uint8_t constant = makeConstant(OBJECT_VAL(heap.intern(name->lexeme)));
   FunctionType type = TYPE_METHOD;
   if (parser.prev->lexeme == "constructor") {
     type = TYPE_CONSTRUCTOR;
@@ -1256,16 +1468,15 @@ void Compiler::method(const Token* name, AccessModifier am) {
 
 void Compiler::dot(bool canAssign) {
   consume(TOKEN_ID, "Expect property name after '.'.");
-  uint8_t name = makeConstant(
-      OBJECT_VAL(std::make_shared<ObjectString>(parser.prev->lexeme)));
+  uint8_t name = makeConstant(OBJECT_VAL(heap.intern(parser.prev->lexeme)));
 
   uint8_t className = 0;
 
   if (classes.empty()) {
-    className = makeConstant(OBJECT_VAL(std::make_shared<ObjectString>("")));
+    className = makeConstant(OBJECT_VAL(heap.intern("")));
   } else {
-    className = makeConstant(OBJECT_VAL(
-        std::make_shared<ObjectString>(classes.back().name->lexeme)));
+    className =
+        makeConstant(OBJECT_VAL(heap.intern(classes.back().name->lexeme)));
   }
 
   OpCode binaryOpCode = matchBinaryEq();
@@ -1276,6 +1487,7 @@ void Compiler::dot(bool canAssign) {
       emitByte(OP_GET_PROPERTY);
       emitByte(name);
       emitByte(className);
+      emitInlineCache();
     }
     expression();
     if (binaryOpCode) {
@@ -1284,16 +1496,19 @@ void Compiler::dot(bool canAssign) {
     emitByte(OP_SET_PROPERTY);
     emitByte(name);
     emitByte(className);
+    emitInlineCache();
   } else if (match(TOKEN_LPAREN)) {
     uint8_t argCount = argumentList();
     emitByte(OP_INVOKE);
     emitByte(name);
     emitByte(argCount);
     emitByte(className);
+    emitInlineCache();
   } else {
     emitByte(OP_GET_PROPERTY);
     emitByte(name);
     emitByte(className);
+    emitInlineCache();
   }
 }
 
@@ -1316,16 +1531,15 @@ void Compiler::super_(bool canAssign) {
   }
   consume(TOKEN_DOT, "Expect '.' after 'super'.");
   consume(TOKEN_ID, "Expect superclass method name.");
-  uint8_t name = makeConstant(
-      OBJECT_VAL(std::make_shared<ObjectString>(parser.prev->lexeme)));
+  uint8_t name = makeConstant(OBJECT_VAL(heap.intern(parser.prev->lexeme)));
 
   uint8_t className = 0;
 
   if (classes.empty()) {
-    className = makeConstant(OBJECT_VAL(std::make_shared<ObjectString>("")));
+    className = makeConstant(OBJECT_VAL(heap.intern("")));
   } else {
-    className = makeConstant(OBJECT_VAL(
-        std::make_shared<ObjectString>(classes.back().name->lexeme)));
+    className =
+        makeConstant(OBJECT_VAL(heap.intern(classes.back().name->lexeme)));
   }
 
   const Token tokenThis = syntheticToken("this");
@@ -10,6 +10,7 @@
 #include <iostream>
 
 #include "chunk.hpp"
+#include "globals.hpp"
 #include "object.hpp"
 #include "token.hpp"
 
@@ -53,6 +54,21 @@ void printValueType(Value value) {
         case OBJECT_LIST:
           std::cout << "OBJECT_LIST";
           break;
+        case OBJECT_MAP:
+          std::cout << "OBJECT_MAP";
+          break;
+        case OBJECT_PRIORITY_QUEUE:
+          std::cout << "OBJECT_PRIORITY_QUEUE";
+          break;
+        case OBJECT_DEQUE:
+          std::cout << "OBJECT_DEQUE";
+          break;
+        case OBJECT_RANDOM:
+          std::cout << "OBJECT_RANDOM";
+          break;
+        case OBJECT_STRING_BUILDER:
+          std::cout << "OBJECT_STRING_BUILDER";
+          break;
       }
       break;
   }
@@ -66,7 +82,7 @@ size_t simpleInstruction(const std::string& name, size_t index) {
 
 size_t constantInstruction(const std::string& name, const Chunk& chunk,
                            size_t index) {
-  uint8_t constantIndex = chunk.getBytecodeAt(index + 1).code;
+  uint8_t constantIndex = chunk.getBytecodeAt(index + 1);
   std::cout << name;
   // const Value& constant = chunk.getConstantAt(constantIndex);
   std::cout << " " << (int)constantIndex;
@@ -77,10 +93,19 @@ size_t constantInstruction(const std::string& name, const Chunk& chunk,
   return index + 2;
 }
 
+size_t globalInstruction(const std::string& name, const Chunk& chunk,
+                         size_t index) {
+  uint16_t global = (uint16_t)((chunk.getBytecodeAt(index + 1) << 8) |
+                               chunk.getBytecodeAt(index + 2));
+  std::cout << name << " " << global << " "
+            << globalTable.getName(global)->getString() << std::endl;
+  return index + 3;
+}
+
 size_t jumpInstruction(const std::string& name, int sign, const Chunk& chunk,
                        size_t index) {
-  uint8_t high = chunk.getBytecodeAt(index + 1).code;
-  uint8_t lo = chunk.getBytecodeAt(index + 2).code;
+  uint8_t high = chunk.getBytecodeAt(index + 1);
+  uint8_t lo = chunk.getBytecodeAt(index + 2);
   uint16_t jump = (uint16_t)((high << 8) | lo);
   std::cout << name << " " << index + 3 + sign * jump << std::endl;
   return index + 3;
@@ -88,28 +113,51 @@ size_t jumpInstruction(const std::string& name, int sign, const Chunk& chunk,
 
 size_t invokeInstruction(const std::string& name, const Chunk& chunk,
                          size_t index) {
-  uint8_t constant = chunk.getBytecodeAt(index + 1).code;
-  uint8_t argCount = chunk.getBytecodeAt(index + 2).code;
+  uint8_t constant = chunk.getBytecodeAt(index + 1);
+  uint8_t argCount = chunk.getBytecodeAt(index + 2);
   std::cout << name << " " << constant << " " << argCount << std::endl;
   return index + 3;
 }
 
 size_t superInvokeInstruction(const std::string& name, const Chunk& chunk,
                               size_t index) {
-  uint8_t constant = chunk.getBytecodeAt(index + 1).code;
-  uint8_t argCount = chunk.getBytecodeAt(index + 2).code;
-  uint8_t xd = chunk.getBytecodeAt(index + 3).code;
+  uint8_t constant = chunk.getBytecodeAt(index + 1);
+  uint8_t argCount = chunk.getBytecodeAt(index + 2);
+  uint8_t xd = chunk.getBytecodeAt(index + 3);
   std::cout << name << " " << constant << " " << argCount << " " << xd
             << std::endl;
   return index + 4;
 }
 
+size_t propertyInstruction(const std::string& name, const Chunk& chunk,
+                           size_t index) {
+  uint8_t constant = chunk.getBytecodeAt(index + 1);
+  uint8_t className = chunk.getBytecodeAt(index + 2);
+  uint16_t cache = (uint16_t)((chunk.getBytecodeAt(index + 3) << 8) |
+                              chunk.getBytecodeAt(index + 4));
+  std::cout << name << " " << (int)constant << " " << (int)className
+            << " cache " << cache << std::endl;
+  return index + 5;
+}
+
+size_t invokeCachedInstruction(const std::string& name, const Chunk& chunk,
+                               size_t index) {
+  uint8_t constant = chunk.getBytecodeAt(index + 1);
+  uint8_t argCount = chunk.getBytecodeAt(index + 2);
+  uint8_t className = chunk.getBytecodeAt(index + 3);
+  uint16_t cache = (uint16_t)((chunk.getBytecodeAt(index + 4) << 8) |
+                              chunk.getBytecodeAt(index + 5));
+  std::cout << name << " " << (int)constant << " " << (int)argCount << " "
+            << (int)className << " cache " << cache << std::endl;
+  return index + 6;
+}
+
 size_t printInstruction(const Chunk& chunk, size_t index) {
   std::cout << std::setfill('0') << std::setw(5) << index << " ";
   std::cout << std::setfill(' ') << std::setw(5)
-            << chunk.getBytecodeAt(index).line << " ";
+            << chunk.getLineAt(index) << " ";
 
-  uint8_t code = chunk.getBytecodeAt(index).code;
+  uint8_t code = chunk.getBytecodeAt(index);
   switch (code) {
     case OP_RETURN:
       return simpleInstruction("OP_RETURN", index);
@@ -144,9 +192,9 @@ size_t printInstruction(const Chunk& chunk, size_t index) {
     case OP_POP:
       return simpleInstruction("OP_POP", index);
     case OP_SET_GLOBAL:
-      return constantInstruction("OP_SET_GLOBAL", chunk, index);
+      return globalInstruction("OP_SET_GLOBAL", chunk, index);
     case OP_GET_GLOBAL:
-      return constantInstruction("OP_GET_GLOBAL", chunk, index);
+      return globalInstruction("OP_GET_GLOBAL", chunk, index);
     case OP_SET_LOCAL:
       return constantInstruction("OP_SET_LOCAL", chunk, index);
     case OP_GET_LOCAL:
@@ -172,29 +220,55 @@ size_t printInstruction(const Chunk& chunk, size_t index) {
     case OP_CLASS:
       return constantInstruction("OP_CLASS", chunk, index);
     case OP_GET_PROPERTY:
-      return invokeInstruction("OP_GET_PROPERTY", chunk, index);
+      return propertyInstruction("OP_GET_PROPERTY", chunk, index);
     case OP_SET_PROPERTY:
-      return invokeInstruction("OP_SET_PROPERTY", chunk, index);
+      return propertyInstruction("OP_SET_PROPERTY", chunk, index);
     case OP_METHOD:
       return invokeInstruction("OP_METHOD", chunk, index);
     case OP_INVOKE:
-      return superInvokeInstruction("OP_INVOKE", chunk, index);
+      return invokeCachedInstruction("OP_INVOKE", chunk, index);
     case OP_INHERIT:
       return simpleInstruction("OP_INHERIT", index);
     case OP_GET_SUPER:
       return constantInstruction("OP_GET_SUPER", chunk, index);
     case OP_SUPER_INVOKE:
-      return invokeInstruction("OP_SUPER_INVOKE", chunk, index);
+      return superInvokeInstruction("OP_SUPER_INVOKE", chunk, index);
     case OP_ARRAY:
       return constantInstruction("OP_ARRAY", chunk, index);
     case OP_ARRAY_SET:
       return simpleInstruction("OP_ARRAY_SET", index);
     case OP_ARRAY_GET:
       return simpleInstruction("OP_ARRAY_GET", index);
+    case OP_MAP:
+      return constantInstruction("OP_MAP", chunk, index);
     case OP_DUPLICATE:
       return constantInstruction("OP_DUPLICATE", chunk, index);
     case OP_FIELD:
       return invokeInstruction("OP_FIELD", chunk, index);
+    case OP_GREATER_NUM:
+      return simpleInstruction("OP_GREATER_NUM", index);
+    case OP_LESS_NUM:
+      return simpleInstruction("OP_LESS_NUM", index);
+    case OP_ADD_NUM:
+      return simpleInstruction("OP_ADD_NUM", index);
+    case OP_SUBSTRACT_NUM:
+      return simpleInstruction("OP_SUBSTRACT_NUM", index);
+    case OP_MULTIPLY_NUM:
+      return simpleInstruction("OP_MULTIPLY_NUM", index);
+    case OP_DIVIDE_NUM:
+      return simpleInstruction("OP_DIVIDE_NUM", index);
+    case OP_MODULO_NUM:
+      return simpleInstruction("OP_MODULO_NUM", index);
+    case OP_SIZE:
+      return constantInstruction("OP_SIZE", chunk, index);
+    case OP_TYPEOF:
+      return constantInstruction("OP_TYPEOF", chunk, index);
+    case OP_IS_INTEGER:
+      return constantInstruction("OP_IS_INTEGER", chunk, index);
+    case OP_FLOOR:
+      return constantInstruction("OP_FLOOR", chunk, index);
+    case OP_CEIL:
+      return constantInstruction("OP_CEIL", chunk, index);
     default: {
       std::cout << "Unknown opcode " << code << std::endl;
       return index + 1;
@@ -225,7 +299,7 @@ void printChunk(const Chunk& chunk, const std::string& name) {
   // for (size_t i = 0; i < chunk.getConstantsSize(); ++i) {
   //   const Value& value = chunk.getConstantAt(i);
   //   if (IS_FUNCTION(value)) {
-  //     std::shared_ptr<ObjectFunction> function = AS_FUNCTION(value);
+  //     ObjectFunction* function = AS_FUNCTION(value);
   //     printChunk(function->getChunk(), function->getName()->getString());
   //   }
   // }
@@ -279,6 +353,9 @@ void printTokens(const std::vector<std::shared_ptr<Token>>& tokens) {
       case TOKEN_SEMI:
         std::cout << "SEMI" << std::endl;
         break;
+      case TOKEN_COLON:
+        std::cout << "COLON" << std::endl;
+        break;
       case TOKEN_LT:
         std::cout << "LT" << std::endl;
         break;
@@ -427,14 +504,13 @@ void printStack(MemoryStack& memory) {
   std::cout << std::endl;
 }
 
-void printGlobals(
-    std::unordered_map<std::shared_ptr<ObjectString>, Value, ObjectString::Hash,
-                       ObjectString::Comparator>& globals) {
-  for (auto& it : globals) {
-    std::cout << "Variable name: " << it.first->getString();
+void printGlobals(const std::vector<Value>& globals) {
+  for (size_t i = 0; i < globals.size(); i++) {
+    if (IS_UNDEFINED(globals[i])) continue;
+    std::cout << "Variable name: " << globalTable.getName(i)->getString();
     std::cout << std::endl;
     std::cout << "Value: ";
-    it.second.printValue();
+    globals[i].printValue();
     std::cout << std::endl;
   }
 }
\ No newline at end of file
@@ -0,0 +1,25 @@
+/*
+ * Copyright (c) Andy Yu and Yunze Zhou
+ * Luminous implementation code written by Yunze Zhou and Andy Yu.
+ * Sharing and altering of the source code is restricted under the MIT License.
+ */
+
+#include "globals.hpp"
+
+#include "heap.hpp"
+
+GlobalTable globalTable;
+
+size_t GlobalTable::indexOf(const std::string& name) {
+  auto it = indices.find(std::string_view(name));
+  if (it != indices.end()) return it->second;
+
+  ObjectString* newName = heap.intern(name);
+  indices.emplace(newName, names.size());
+  names.push_back(newName);
+  return names.size() - 1;
+}
+
+ObjectString* GlobalTable::getName(size_t index) const { return names[index]; }
+
+size_t GlobalTable::size() const { return names.size(); }
@@ -0,0 +1,292 @@
+/*
+ * Copyright (c) Andy Yu and Yunze Zhou
+ * Luminous implementation code written by Yunze Zhou and Andy Yu.
+ * Sharing and altering of the source code is restricted under the MIT License.
+ */
+
+#include "heap.hpp"
+
+#include <chrono>
+#include <iostream>
+
+#include "compiler.hpp"
+#include "vm.hpp"
+
+Heap heap;
+
+size_t Heap::sizeOf(const Object* object) {
+  switch (object->getType()) {
+    case OBJECT_BOUND_METHOD:
+      return sizeof(ObjectBoundMethod);
+    case OBJECT_CLASS:
+      return sizeof(ObjectClass) +
+             ((ObjectClass*)object)->getDefaultFields().size() * sizeof(Value);
+    case OBJECT_CLOSURE:
+      return sizeof(ObjectClosure) +
+             ((ObjectClosure*)object)->getUpvaluesSize() *
+                 sizeof(ObjectUpvalue*);
+    case OBJECT_FUNCTION: {
+      Chunk& chunk = ((ObjectFunction*)object)->getChunk();
+      return sizeof(ObjectFunction) + chunk.getBytecodeSize() +
+             chunk.getConstantsSize() * sizeof(Value) +
+             chunk.getInlineCachesSize() * sizeof(InlineCache);
+    }
+    case OBJECT_INSTANCE:
+      return sizeof(ObjectInstance) +
+             ((ObjectInstance*)object)->getFields().size() * sizeof(Value);
+    case OBJECT_NATIVE:
+      return sizeof(ObjectNative);
+    case OBJECT_STRING: {
+      // ropes and slices must not be flattened here, their contents aren't
+      // allocated yet
+      ObjectString* string = (ObjectString*)object;
+      return sizeof(ObjectString) +
+             (string->isRope() || string->isSlice()
+                  ? 0
+                  : string->getString().capacity());
+    }
+    case OBJECT_UPVALUE:
+      return sizeof(ObjectUpvalue);
+    case OBJECT_LIST:
+      return sizeof(ObjectList) +
+             ((ObjectList*)object)->getCapacity() * sizeof(Value);
+    case OBJECT_MAP: {
+      ObjectMap* map = (ObjectMap*)object;
+      return sizeof(ObjectMap) +
+             map->getEntries().capacity() * sizeof(ObjectMap::Entry) +
+             map->getCapacity() * sizeof(int32_t);
+    }
+    case OBJECT_PRIORITY_QUEUE:
+      return sizeof(ObjectPriorityQueue) +
+             ((ObjectPriorityQueue*)object)->getEntries().capacity() *
+                 sizeof(ObjectPriorityQueue::Entry);
+    case OBJECT_DEQUE:
+      return sizeof(ObjectDeque) +
+             ((ObjectDeque*)object)->getCapacity() * sizeof(Value);
+    case OBJECT_RANDOM:
+      return sizeof(ObjectRandom);
+    case OBJECT_STRING_BUILDER:
+      return sizeof(ObjectStringBuilder) +
+             ((ObjectStringBuilder*)object)->getCapacity();
+  }
+  return 0;  // unreachable
+}
+
+ObjectString* Heap::intern(std::string_view str) {
+  auto it = strings.find(str);
+  if (it != strings.end()) return *it;
+
+  ObjectString* string = allocate<ObjectString>(std::string(str));
+  string->interned = true;
+  strings.insert(string);
+  return string;
+}
+
+void Heap::setVM(VM* vm) { this->vm = vm; }
+
+void Heap::setCompiler(Compiler* compiler) { this->compiler = compiler; }
+
+void Heap::markObject(const Object* object) {
+  if (object == nullptr || object->marked) return;
+  object->marked = true;
+  grayStack.push_back(object);
+}
+
+void Heap::markValue(Value value) {
+  if (IS_OBJECT(value)) markObject(AS_OBJECT(value));
+}
+
+void Heap::markRoots() {
+  if (vm != nullptr) vm->markRoots();
+  if (compiler != nullptr) compiler->markRoots();
+}
+
+void Heap::blackenObject(const Object* object) {
+  switch (object->getType()) {
+    case OBJECT_BOUND_METHOD: {
+      ObjectBoundMethod* bound = (ObjectBoundMethod*)object;
+      markValue(bound->getReceiver());
+      markObject(bound->getMethod());
+      break;
+    }
+    case OBJECT_CLASS: {
+      ObjectClass* objClass = (ObjectClass*)object;
+      markObject(&objClass->getName());
+      for (auto& it : objClass->getMethods()) {
+        markObject(it.first);
+        markValue(it.second.first);
+      }
+      for (auto& it : objClass->getShape()) {
+        markObject(it.first);
+      }
+      break;
+    }
+    case OBJECT_CLOSURE: {
+      ObjectClosure* closure = (ObjectClosure*)object;
+      markObject(closure->getFunction());
+      for (size_t i = 0; i < closure->getUpvaluesSize(); i++) {
+        markObject(closure->getUpvalue(i));
+      }
+      break;
+    }
+    case OBJECT_FUNCTION: {
+      ObjectFunction* function = (ObjectFunction*)object;
+      markObject(function->getName());
+      Chunk& chunk = function->getChunk();
+      for (size_t i = 0; i < chunk.getConstantsSize(); i++) {
+        markValue(chunk.getConstantAt(i));
+      }
+      // cached classes must stay alive so that their addresses can't be
+      // reused by another class
+      for (size_t i = 0; i < chunk.getInlineCachesSize(); i++) {
+        for (const CacheEntry& entry : chunk.getInlineCacheAt(i).entries) {
+          markObject(entry.objClass);
+          markObject(entry.method);
+        }
+      }
+      break;
+    }
+    case OBJECT_INSTANCE: {
+      ObjectInstance* instance = (ObjectInstance*)object;
+      markObject(&instance->getInstanceOf());
+      for (Value value : instance->getFields()) {
+        markValue(value);
+      }
+      break;
+    }
+    case OBJECT_NATIVE: {
+      markObject(((ObjectNative*)object)->getName());
+      break;
+    }
+    case OBJECT_RANDOM:
+      break;
+    case OBJECT_STRING_BUILDER: {
+      markObject(((ObjectStringBuilder*)object)->getBuilt());
+      break;
+    }
+    case OBJECT_STRING: {
+      ObjectString* string = (ObjectString*)object;
+      if (string->isSlice() && string->getLength() * SLICE_COMPACT_RATIO <
+                                   string->getParent()->getLength()) {
+        string->flatten();
+      }
+      markObject(string->getLeft());
+      markObject(string->getRight());
+      markObject(string->getParent());
+      break;
+    }
+    case OBJECT_UPVALUE: {
+      markValue(((ObjectUpvalue*)object)->closed);
+      break;
+    }
+    case OBJECT_LIST: {
+      ObjectList* list = (ObjectList*)object;
+      for (size_t i = 0; i < list->size(); i++) {
+        markValue(list->get(i));
+      }
+      break;
+    }
+    case OBJECT_MAP: {
+      for (const ObjectMap::Entry& entry :
+           ((ObjectMap*)object)->getEntries()) {
+        markValue(entry.key);
+        markValue(entry.value);
+      }
+      break;
+    }
+    case OBJECT_PRIORITY_QUEUE: {
+      for (const ObjectPriorityQueue::Entry& entry :
+           ((ObjectPriorityQueue*)object)->getEntries()) {
+        markValue(entry.key);
+        markValue(entry.value);
+      }
+      break;
+    }
+    case OBJECT_DEQUE: {
+      ObjectDeque* deque = (ObjectDeque*)object;
+      for (size_t i = 0; i < deque->size(); i++) {
+        markValue(deque->get(i));
+      }
+      break;
+    }
+  }
+}
+
+void Heap::traceReferences() {
+  while (!grayStack.empty()) {
+    const Object* object = grayStack.back();
+    grayStack.pop_back();
+    blackenObject(object);
+  }
+}
+
+void Heap::sweep() {
+  Object* prev = nullptr;
+  Object* object = objects;
+  size_t liveBytes = 0;
+
+  while (object != nullptr) {
+    if (object->marked) {
+      object->marked = false;
+      liveBytes += sizeOf(object);
+      prev = object;
+      object = object->nextObject;
+    } else {
+      Object* unreached = object;
+      object = object->nextObject;
+      if (prev == nullptr) {
+        objects = object;
+      } else {
+        prev->nextObject = object;
+      }
+
+      if (unreached->getType() == OBJECT_STRING &&
+          ((ObjectString*)unreached)->isInterned()) {
+        strings.erase((ObjectString*)unreached);
+      }
+      objectsFreed++;
+      delete unreached;
+    }
+  }
+
+  bytesFreed += bytesAllocated > liveBytes ? bytesAllocated - liveBytes : 0;
+  bytesAllocated = liveBytes;
+}
+
+void Heap::collectGarbage() {
+  auto start = std::chrono::steady_clock::now();
+
+  markRoots();
+  traceReferences();
+  sweep();
+
+  nextGC = bytesAllocated * GC_HEAP_GROW_FACTOR;
+  if (nextGC < GC_MIN_HEAP_SIZE) nextGC = GC_MIN_HEAP_SIZE;
+
+  collections++;
+  gcSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                             start)
+                   .count();
+}
+
+void Heap::printStats() const {
+  std::cerr << "== GC STATS ==" << std::endl;
+  std::cerr << "Collections: " << collections << std::endl;
+  std::cerr << "Objects freed: " << objectsFreed << std::endl;
+  std::cerr << "Bytes freed: " << bytesFreed << std::endl;
+  std::cerr << "Peak heap size: " << peakBytes << " bytes" << std::endl;
+  std::cerr << "Live heap size: " << bytesAllocated << " bytes" << std::endl;
+  std::cerr << "Time in GC: " << gcSeconds * 1000 << " ms" << std::endl;
+}
+
+void Heap::freeObjects() {
+  while (objects != nullptr) {
+    Object* next = objects->nextObject;
+    delete objects;
+    objects = next;
+  }
+  strings.clear();
+  bytesAllocated = 0;
+}
+
+Heap::~Heap() { freeObjects(); }
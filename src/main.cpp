@@ -10,6 +10,7 @@
 #include "chunk.hpp"
 #include "compiler.hpp"
 #include "debug.hpp"
+#include "heap.hpp"
 #include "vm.hpp"
 
 static void run(Compiler& compiler, VM& vm, const std::string& code,
@@ -60,17 +61,24 @@ static void runFile(Compiler& compiler, VM& vm, char* path) {
 int main(int argc, char* argv[]) {
   int argcWithoutFlags = 0;
   char* path;
+  bool gcStats = false;
+  bool lineBuffered = false;
   for (int i = 0; i < argc; i++) {
     if (argv[i][0] != '-') {
       if (argcWithoutFlags == 1) {
         path = argv[i];
       }
       argcWithoutFlags++;
+    } else if (std::string(argv[i]) == "--gc-stats") {
+      gcStats = true;
+    } else if (std::string(argv[i]) == "--line-buffered") {
+      lineBuffered = true;
     }
   }
 
   Compiler compiler;
   VM vm;
+  vm.setLineBuffered(lineBuffered);
 
   // interpret depending on num args
   if (argcWithoutFlags == 1) {
@@ -78,8 +86,12 @@ int main(int argc, char* argv[]) {
   } else if (argcWithoutFlags == 2) {
     runFile(compiler, vm, path);
   } else {
-    std::cerr << "Usage ./luminous [path]" << std::endl;
+    std::cerr << "Usage ./luminous [--gc-stats] [--line-buffered] [path]"
+              << std::endl;
     return 1;
   }
+
+  std::cout.flush();
+  if (gcStats) heap.printStats();
   return 0;
 }
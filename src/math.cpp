@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) Andy Yu and Yunze Zhou
+ * Luminous implementation code written by Yunze Zhou and Andy Yu.
+ * Sharing and altering of the source code is restricted under the MIT License.
+ */
+
+#include <cmath>
+#include <vector>
+
+#include "object.hpp"
+#include "vm.hpp"
+
+// Math natives take a number, or a list of numbers for their bulk form. The
+// bulk form copies the list into a plain array of doubles and applies the
+// function to each of them.
+
+bool VM::listToNumbers(Value list, std::vector<double>& numbers) {
+  ObjectList* actualList = AS_OBJECTLIST(list);
+  numbers.resize(actualList->size());
+  for (size_t i = 0; i < numbers.size(); i++) {
+    Value item = actualList->get(i);
+    if (!IS_NUM(item)) return false;
+    numbers[i] = AS_NUM(item);
+  }
+  return true;
+}
+
+Value VM::numbersToList(const std::vector<double>& numbers) {
+  std::vector<Value> values(numbers.size());
+  for (size_t i = 0; i < numbers.size(); i++) {
+    values[i] = NUM_VAL(numbers[i]);
+  }
+  return OBJECT_VAL(heap.allocate<ObjectList>(std::move(values)));
+}
+
+template <typename Function>
+Value VM::mathNative(const char* name, Value arg, Function function) {
+  if (IS_NUM(arg)) return NUM_VAL(function(AS_NUM(arg)));
+
+  std::vector<double> numbers;
+  if (!IS_LIST(arg) || !listToNumbers(arg, numbers)) {
+    runtimeError("Expect a number or a list of numbers for '%s'.", name);
+  }
+  for (size_t i = 0; i < numbers.size(); i++) {
+    numbers[i] = function(numbers[i]);
+  }
+  return numbersToList(numbers);
+}
+
+Value VM::absNative(VM& vm, std::span<Value> args) {
+  return vm.mathNative("abs", args[0], [](double x) { return std::fabs(x); });
+}
+
+Value VM::sqrtNative(VM& vm, std::span<Value> args) {
+  return vm.mathNative("sqrt", args[0], [](double x) { return std::sqrt(x); });
+}
+
+Value VM::expNative(VM& vm, std::span<Value> args) {
+  return vm.mathNative("exp", args[0], [](double x) { return std::exp(x); });
+}
+
+Value VM::logNative(VM& vm, std::span<Value> args) {
+  return vm.mathNative("log", args[0], [](double x) { return std::log(x); });
+}
+
+Value VM::sinNative(VM& vm, std::span<Value> args) {
+  return vm.mathNative("sin", args[0], [](double x) { return std::sin(x); });
+}
+
+Value VM::cosNative(VM& vm, std::span<Value> args) {
+  return vm.mathNative("cos", args[0], [](double x) { return std::cos(x); });
+}
+
+Value VM::tanNative(VM& vm, std::span<Value> args) {
+  return vm.mathNative("tan", args[0], [](double x) { return std::tan(x); });
+}
+
+Value VM::asinNative(VM& vm, std::span<Value> args) {
+  return vm.mathNative("asin", args[0], [](double x) { return std::asin(x); });
+}
+
+Value VM::acosNative(VM& vm, std::span<Value> args) {
+  return vm.mathNative("acos", args[0], [](double x) { return std::acos(x); });
+}
+
+Value VM::atanNative(VM& vm, std::span<Value> args) {
+  return vm.mathNative("atan", args[0], [](double x) { return std::atan(x); });
+}
+
+Value VM::powNative(VM& vm, std::span<Value> args) {
+  Value base = args[0];
+  Value exponent = args[1];
+  if (!IS_NUM(exponent)) {
+    vm.runtimeError("Expect a number as exponent for 'pow'.");
+  }
+  double actualExponent = AS_NUM(exponent);
+  if (IS_NUM(base)) return NUM_VAL(std::pow(AS_NUM(base), actualExponent));
+
+  std::vector<double> numbers;
+  if (!IS_LIST(base) || !listToNumbers(base, numbers)) {
+    vm.runtimeError("Expect a number or a list of numbers for 'pow'.");
+  }
+  for (size_t i = 0; i < numbers.size(); i++) {
+    numbers[i] = std::pow(numbers[i], actualExponent);
+  }
+  return numbersToList(numbers);
+}
+
+Value VM::extremumNative(const char* name, std::span<Value> args,
+                         bool isMax) {
+  // either a single list, or the numbers themselves
+  std::vector<double> numbers;
+  Value first = args[0];
+  if (args.size() == 1 && IS_LIST(first)) {
+    if (!listToNumbers(first, numbers)) {
+      runtimeError("Expect a list of numbers for '%s'.", name);
+    }
+  } else {
+    numbers.resize(args.size());
+    for (size_t i = 0; i < args.size(); i++) {
+      Value arg = args[i];
+      if (!IS_NUM(arg)) {
+        runtimeError("Expect numbers as arguments for '%s'.", name);
+      }
+      numbers[i] = AS_NUM(arg);
+    }
+  }
+  if (numbers.empty()) {
+    runtimeError("Cannot take '%s' of an empty list.", name);
+  }
+
+  double result = numbers[0];
+  if (isMax) {
+    for (size_t i = 1; i < numbers.size(); i++) {
+      result = numbers[i] > result ? numbers[i] : result;
+    }
+  } else {
+    for (size_t i = 1; i < numbers.size(); i++) {
+      result = numbers[i] < result ? numbers[i] : result;
+    }
+  }
+  return NUM_VAL(result);
+}
+
+Value VM::minNative(VM& vm, std::span<Value> args) {
+  return vm.extremumNative("min", args, false);
+}
+
+Value VM::maxNative(VM& vm, std::span<Value> args) {
+  return vm.extremumNative("max", args, true);
+}
+
+Value VM::sumNative(VM& vm, std::span<Value> args) {
+  Value list = args[0];
+  std::vector<double> numbers;
+  if (!IS_LIST(list) || !listToNumbers(list, numbers)) {
+    vm.runtimeError("Expect a list of numbers for 'sum'.");
+  }
+
+  // independent partial sums, so the additions don't wait on each other
+  double partial[4] = {0, 0, 0, 0};
+  size_t i = 0;
+  for (; i + 4 <= numbers.size(); i += 4) {
+    partial[0] += numbers[i];
+    partial[1] += numbers[i + 1];
+    partial[2] += numbers[i + 2];
+    partial[3] += numbers[i + 3];
+  }
+  for (; i < numbers.size(); i++) {
+    partial[0] += numbers[i];
+  }
+  return NUM_VAL((partial[0] + partial[1]) + (partial[2] + partial[3]));
+}
+
+void VM::defineMathNatives() {
+  defineNative("abs", absNative, 1);
+  defineNative("sqrt", sqrtNative, 1);
+  defineNative("exp", expNative, 1);
+  defineNative("log", logNative, 1);
+  defineNative("sin", sinNative, 1);
+  defineNative("cos", cosNative, 1);
+  defineNative("tan", tanNative, 1);
+  defineNative("asin", asinNative, 1);
+  defineNative("acos", acosNative, 1);
+  defineNative("atan", atanNative, 1);
+  defineNative("pow", powNative, 2);
+  defineNative("min", minNative, 1, ObjectNative::VARIADIC);
+  defineNative("max", maxNative, 1, ObjectNative::VARIADIC);
+  defineNative("sum", sumNative, 1);
+}
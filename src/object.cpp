@@ -7,17 +7,107 @@
 #include "object.hpp"
 
 #include <iostream>
+#include <utility>
+
+#include "heap.hpp"
+
+// tells the heap that a buffer was reallocated in place, so that containers
+// filled after they were allocated still count towards the next collection
+template <typename Buffer>
+static void reportResize(const Buffer& buffer, size_t oldCapacity) {
+  if (buffer.capacity() == oldCapacity) return;
+  heap.adjust(oldCapacity * sizeof(typename Buffer::value_type),
+              buffer.capacity() * sizeof(typename Buffer::value_type));
+}
 
 Object::Object(ObjectType type) : type{type} {}
 
 ObjectType Object::getType() const { return type; }
 
-ObjectString::ObjectString(const std::string& str)
-    : Object(OBJECT_STRING), str{str}, hash{std::hash<std::string>{}(str)} {}
+ObjectString::ObjectString(std::string str)
+    : Object(OBJECT_STRING),
+      str{std::move(str)},
+      hash{std::hash<std::string>{}(this->str)},
+      length{this->str.size()} {}
+
+ObjectString::ObjectString(const ObjectString* left, const ObjectString* right)
+    : Object(OBJECT_STRING),
+      left{left},
+      right{right},
+      length{left->getLength() + right->getLength()} {}
+
+ObjectString::ObjectString(const ObjectString* parent, size_t offset,
+                           size_t length)
+    : Object(OBJECT_STRING),
+      parent{parent->isSlice() ? parent->parent : parent},
+      offset{parent->isSlice() ? parent->offset + offset : offset},
+      length{length} {
+  // slices always point into a flat string
+  if (this->parent->isRope()) this->parent->flatten();
+}
+
+void ObjectString::flatten() const {
+  if (isSlice()) {
+    str = parent->str.substr(offset, length);
+    hash = std::hash<std::string>{}(str);
+    parent = nullptr;
+    // a slice's characters belonged to its parent until now
+    reportResize(str, 0);
+    return;
+  }
+
+  std::string flat;
+  flat.reserve(length);
+
+  // ropes built by repeated appends are deep, so walk them without recursion
+  std::vector<const ObjectString*> pending{this};
+  while (!pending.empty()) {
+    const ObjectString* node = pending.back();
+    pending.pop_back();
+    if (node->isRope()) {
+      pending.push_back(node->right);
+      pending.push_back(node->left);
+    } else {
+      flat += node->getView();
+    }
+  }
+
+  str = std::move(flat);
+  hash = std::hash<std::string>{}(str);
+  left = nullptr;
+  right = nullptr;
+  // a rope's characters weren't counted until now
+  reportResize(str, 0);
+}
+
+const std::string& ObjectString::getString() const {
+  if (isRope() || isSlice()) flatten();
+  return str;
+}
+
+size_t ObjectString::getHash() const {
+  if (isRope() || isSlice()) flatten();
+  return hash;
+}
+
+std::string_view ObjectString::getView() const {
+  if (isSlice()) return std::string_view(parent->str).substr(offset, length);
+  return getString();
+}
+
+size_t ObjectString::getLength() const { return length; }
+
+bool ObjectString::isRope() const { return left != nullptr; }
+
+bool ObjectString::isSlice() const { return parent != nullptr; }
+
+bool ObjectString::isInterned() const { return interned; }
 
-const std::string& ObjectString::getString() const { return str; }
+const ObjectString* ObjectString::getLeft() const { return left; }
 
-size_t ObjectString::getHash() const { return hash; }
+const ObjectString* ObjectString::getRight() const { return right; }
+
+const ObjectString* ObjectString::getParent() const { return parent; }
 
 void Object::printObject() const {
   switch (type) {
@@ -47,17 +137,20 @@ void Object::printObject() const {
 #ifdef DEBUG
       std::cout << std::endl;
       std::cout << "Fields:" << std::endl;
-      for (auto& it : ((ObjectInstance*)this)->getFields()) {
+      for (auto& it :
+           ((ObjectInstance*)this)->getInstanceOf().getShape()) {
+        const Value* value = ((ObjectInstance*)this)->getField(it.first);
+        if (value == nullptr) continue;
         std::cout << "Name: " << it.first->getString() << std::endl;
         std::cout << "Value: ";
-        it.second.printValue();
+        value->printValue();
         std::cout << std::endl;
       }
 #endif
       break;
     }
     case OBJECT_STRING: {
-      std::cout << ((ObjectString*)this)->getString();
+      std::cout << ((ObjectString*)this)->getView();
       break;
     }
     case OBJECT_NATIVE: {
@@ -70,25 +163,61 @@ void Object::printObject() const {
     }
     case OBJECT_LIST: {
       ((ObjectList*)this)->printList();
+      break;
+    }
+    case OBJECT_MAP: {
+      ((ObjectMap*)this)->printMap();
+      break;
+    }
+    case OBJECT_PRIORITY_QUEUE: {
+      std::cout << "priority queue";
+      break;
+    }
+    case OBJECT_DEQUE: {
+      ((ObjectDeque*)this)->printDeque();
+      break;
+    }
+    case OBJECT_RANDOM: {
+      std::cout << "random generator";
+      break;
+    }
+    case OBJECT_STRING_BUILDER: {
+      std::cout << ((ObjectStringBuilder*)this)->getView();
+      break;
     }
   }
 }
 
-size_t ObjectString::Hash::operator()(
-    const std::shared_ptr<ObjectString>& a) const {
+size_t ObjectString::Hash::operator()(const ObjectString* a) const {
   return a->getHash();
 }
 
-bool ObjectString::Comparator::operator()(
-    const std::shared_ptr<ObjectString>& a,
-    const std::shared_ptr<ObjectString>& b) const {
-  return a->getString() == b->getString();
+size_t ObjectString::Hash::operator()(std::string_view a) const {
+  return std::hash<std::string_view>{}(a);
+}
+
+bool ObjectString::Comparator::operator()(const ObjectString* a,
+                                          const ObjectString* b) const {
+  if (a == b) return true;
+  // interned strings are equal exactly when they are the same object
+  if (a->isInterned() && b->isInterned()) return false;
+  return a->getLength() == b->getLength() && a->getView() == b->getView();
+}
+
+bool ObjectString::Comparator::operator()(std::string_view a,
+                                          const ObjectString* b) const {
+  return a == b->getView();
 }
 
-ObjectFunction::ObjectFunction(std::shared_ptr<ObjectString> name)
+bool ObjectString::Comparator::operator()(const ObjectString* a,
+                                          std::string_view b) const {
+  return a->getView() == b;
+}
+
+ObjectFunction::ObjectFunction(ObjectString* name)
     : Object(OBJECT_FUNCTION), name{name} {}
 
-const std::shared_ptr<ObjectString> ObjectFunction::getName() const {
+ObjectString* ObjectFunction::getName() const {
   return name;
 }
 
@@ -100,31 +229,30 @@ bool ObjectFunction::empty() const { return chunk.getBytecodeSize() == 0; }
 
 int ObjectFunction::getArity() const { return arity; }
 
-ObjectNative::ObjectNative(const NativeFn function,
-                           const std::shared_ptr<ObjectString> name)
-    : Object(OBJECT_NATIVE), function{function}, name{name} {}
-
-NativeFn ObjectNative::getFunction() { return function; }
+ObjectNative::ObjectNative(NativeFn function, int minArity, int maxArity,
+                           ObjectString* name)
+    : Object(OBJECT_NATIVE),
+      function{function},
+      minArity{minArity},
+      maxArity{maxArity},
+      name{name} {}
 
-std::shared_ptr<ObjectString> ObjectNative::getName() { return name; }
+ObjectString* ObjectNative::getName() { return name; }
 
-ObjectClosure::ObjectClosure(std::shared_ptr<ObjectFunction> function)
+ObjectClosure::ObjectClosure(ObjectFunction* function)
     : Object(OBJECT_CLOSURE), function{function} {
   upvalueCount = function->getUpvalueCount();
 }
 
-std::shared_ptr<ObjectFunction> ObjectClosure::getFunction() {
-  return function;
-}
+ObjectFunction* ObjectClosure::getFunction() { return function; }
 
 size_t ObjectClosure::getUpvaluesSize() const { return upvalues.size(); }
 
-void ObjectClosure::setUpvalue(int index,
-                               std::shared_ptr<ObjectUpvalue> upvalue) {
+void ObjectClosure::setUpvalue(int index, ObjectUpvalue* upvalue) {
   upvalues[index] = upvalue;
 }
 
-std::shared_ptr<ObjectUpvalue> ObjectClosure::getUpvalue(int index) const {
+ObjectUpvalue* ObjectClosure::getUpvalue(int index) const {
   return upvalues[index];
 }
 
@@ -139,21 +267,24 @@ void ObjectFunction::increateUpvalueCount() { upvalueCount++; }
 
 int ObjectFunction::getUpvalueCount() const { return upvalueCount; }
 
+size_t ObjectFunction::getMaxStack() const { return maxStack; }
+
+void ObjectFunction::setMaxStack(size_t size) { maxStack = size; }
+
 int ObjectClosure::getUpvalueCount() const { return upvalueCount; }
 
-void ObjectClosure::addUpvalue(std::shared_ptr<ObjectUpvalue> upvalue) {
+void ObjectClosure::addUpvalue(ObjectUpvalue* upvalue) {
   upvalues.push_back(upvalue);
 }
 
 int ObjectUpvalue::getLocationIndex() const { return locationIndex; }
 
-ObjectClass::ObjectClass(const std::string& name)
-    : Object(OBJECT_CLASS), name{ObjectString(name)} {}
+ObjectClass::ObjectClass(ObjectString* name)
+    : Object(OBJECT_CLASS), name{name} {}
 
-const ObjectString& ObjectClass::getName() const { return name; }
+const ObjectString& ObjectClass::getName() const { return *name; }
 
-const AccessModifier* ObjectClass::getAccessModifier(
-    std::shared_ptr<ObjectString> name) const {
+const AccessModifier* ObjectClass::getAccessModifier(ObjectString* name) const {
   if (fields.find(name) == fields.end()) {
     if (methods.find(name) == methods.end()) {
       return nullptr;
@@ -163,25 +294,59 @@ const AccessModifier* ObjectClass::getAccessModifier(
   return &(fields.find(name)->second);
 }
 
-const Value* ObjectClass::getMethod(std::shared_ptr<ObjectString> name) const {
+const Value* ObjectClass::getMethod(ObjectString* name) const {
   if (methods.find(name) == methods.end()) return nullptr;
   return &(methods.find(name)->second.first);
 }
 
-const std::unordered_map<std::shared_ptr<ObjectString>, AccessModifier,
-                         ObjectString::Hash, ObjectString::Comparator>&
+const std::unordered_map<ObjectString*, AccessModifier, ObjectString::Hash,
+                         ObjectString::Comparator>&
 ObjectClass::getFields() const {
   return fields;
 }
 
-void ObjectClass::setField(std::shared_ptr<ObjectString> name,
+const std::unordered_map<ObjectString*, std::pair<Value, AccessModifier>,
+                         ObjectString::Hash, ObjectString::Comparator>&
+ObjectClass::getMethods() const {
+  return methods;
+}
+
+const std::unordered_map<ObjectString*, size_t, ObjectString::Hash,
+                         ObjectString::Comparator>&
+ObjectClass::getShape() const {
+  return shape;
+}
+
+const std::vector<Value>& ObjectClass::getDefaultFields() const {
+  return defaultFields;
+}
+
+int ObjectClass::getSlot(ObjectString* name) const {
+  auto it = shape.find(name);
+  if (it == shape.end()) return -1;
+  return it->second;
+}
+
+size_t ObjectClass::addSlot(ObjectString* name) {
+  auto it = shape.find(name);
+  if (it != shape.end()) return it->second;
+  shape.emplace(name, defaultFields.size());
+  defaultFields.push_back(UNDEFINED_VAL);
+  version++;
+  return defaultFields.size() - 1;
+}
+
+void ObjectClass::setField(ObjectString* name,
                            AccessModifier accessModifier) {
   fields.insert_or_assign(name, accessModifier);
+  defaultFields[addSlot(name)] = NULL_VAL;
+  version++;
 }
 
-void ObjectClass::setMethod(std::shared_ptr<ObjectString> name, Value method,
+void ObjectClass::setMethod(ObjectString* name, Value method,
                             AccessModifier am) {
   methods.insert_or_assign(name, std::make_pair(method, am));
+  version++;
 }
 
 void ObjectClass::copyMethodsFrom(const ObjectClass& parent) {
@@ -190,59 +355,71 @@ void ObjectClass::copyMethodsFrom(const ObjectClass& parent) {
       methods.insert_or_assign(it.first, it.second);
     }
   }
+  version++;
 }
 
 void ObjectClass::copyFieldsFrom(const ObjectClass& parent) {
   for (auto& it : parent.fields) {
     if (it.second != AccessModifier::ACCESS_PRIVATE) {
-      fields.insert_or_assign(it.first, it.second);
+      setField(it.first, it.second);
     }
   }
 }
 
-ObjectInstance::ObjectInstance(const ObjectClass& instanceOf)
-    : Object(OBJECT_INSTANCE), instanceOf{instanceOf} {
-  for (auto& it : instanceOf.getFields()) {
-    setField(it.first, NULL_VAL);
-  }
-}
-
-const ObjectClass& ObjectInstance::getInstanceOf() const { return instanceOf; }
+ObjectInstance::ObjectInstance(ObjectClass& instanceOf)
+    : Object(OBJECT_INSTANCE),
+      instanceOf{&instanceOf},
+      fields{instanceOf.getDefaultFields()} {}
 
-const Value* ObjectInstance::getField(
-    std::shared_ptr<ObjectString> name) const {
-  if (fields.find(name) == fields.end()) return nullptr;
-  return &(fields.find(name)->second);
+const ObjectClass& ObjectInstance::getInstanceOf() const {
+  return *instanceOf;
 }
 
-void nullDeleter(ObjectInstance* toVoid) { (void)toVoid; }
-
-void ObjectInstance::setField(std::shared_ptr<ObjectString> name, Value value) {
-  if (IS_INSTANCE(value) && AS_INSTANCE(value).get() == this) {
-    std::shared_ptr<ObjectInstance> copy(AS_INSTANCE(value).get(),
-                                         &nullDeleter);
-    fields.insert_or_assign(name, OBJECT_VAL(copy));
-  } else {
-    fields.insert_or_assign(name, value);
+const Value* ObjectInstance::getField(ObjectString* name) const {
+  int slot = instanceOf->getSlot(name);
+  if (slot == -1 || (size_t)slot >= fields.size() ||
+      IS_UNDEFINED(fields[slot])) {
+    return nullptr;
   }
+  return &(fields[slot]);
 }
 
-ObjectBoundMethod::ObjectBoundMethod(Value receiver,
-                                     std::shared_ptr<ObjectClosure> method)
+void ObjectInstance::setField(ObjectString* name, Value value) {
+  size_t slot = instanceOf->addSlot(name);
+  // the slot may have been appended after this instance was created
+  if (slot >= fields.size()) fields.resize(slot + 1, UNDEFINED_VAL);
+  fields[slot] = value;
+}
+
+ObjectBoundMethod::ObjectBoundMethod(Value receiver, ObjectClosure* method)
     : Object(OBJECT_BOUND_METHOD), receiver{receiver}, method{method} {}
 
 Value ObjectBoundMethod::getReceiver() const { return receiver; }
 
-std::shared_ptr<ObjectClosure> ObjectBoundMethod::getMethod() const {
-  return method;
-}
+ObjectClosure* ObjectBoundMethod::getMethod() const { return method; }
 
 ObjectList::ObjectList() : Object(OBJECT_LIST) {}
 ObjectList::ObjectList(std::vector<Value> list)
-    : Object{OBJECT_LIST}, list{list} {}
-void ObjectList::add(Value v) { list.push_back(v); }
+    : Object{OBJECT_LIST}, list{std::move(list)} {}
+void ObjectList::add(Value v) {
+  size_t capacity = list.capacity();
+  list.push_back(v);
+  reportResize(list, capacity);
+}
 Value ObjectList::get(int i) const { return list[i]; }
 
+void ObjectList::insert(Value v, size_t i) {
+  size_t capacity = list.capacity();
+  list.insert(list.begin() + i, v);
+  reportResize(list, capacity);
+}
+
+Value ObjectList::removeAt(size_t i) {
+  Value removed = list[i];
+  list.erase(list.begin() + i);
+  return removed;
+}
+
 void ObjectList::printList() const {
   std::cout << "[";
   for (unsigned i = 0; i < list.size(); i++) {
@@ -256,4 +433,325 @@ void ObjectList::printList() const {
 
 size_t ObjectList::size() const { return list.size(); }
 
+size_t ObjectList::getCapacity() const { return list.capacity(); }
+
 void ObjectList::set(Value v, int i) { list[i] = v; }
+
+ObjectMap::ObjectMap() : Object(OBJECT_MAP) {}
+
+size_t ObjectMap::hashValue(Value key) {
+  if (IS_NUM(key)) return std::hash<double>{}(AS_NUM(key));
+  // strings are hashed by content, since ropes aren't interned
+  if (IS_STRING(key)) return AS_OBJECTSTRING(key)->getHash();
+  if (IS_OBJECT(key)) return std::hash<const Object*>{}(AS_OBJECT(key));
+  if (IS_BOOL(key)) return AS_BOOL(key) ? 1 : 2;
+  return 0;
+}
+
+size_t ObjectMap::findIndex(Value key, size_t hash) const {
+  size_t mask = indices.size() - 1;
+  size_t index = hash & mask;
+  while (true) {
+    int32_t entry = indices[index];
+    if (entry == EMPTY) return index;
+    if (entry != DELETED && entries[entry].hash == hash &&
+        entries[entry].key == key) {
+      return index;
+    }
+    index = (index + 1) & mask;
+  }
+}
+
+void ObjectMap::rebuild(size_t capacity) {
+  size_t entriesCapacity = entries.capacity();
+  size_t indicesCapacity = indices.capacity();
+
+  std::vector<Entry> live;
+  live.reserve(count);
+  for (const Entry& entry : entries) {
+    if (!IS_UNDEFINED(entry.key)) live.push_back(entry);
+  }
+  entries = std::move(live);
+
+  indices.assign(capacity, EMPTY);
+  for (size_t i = 0; i < entries.size(); i++) {
+    indices[findIndex(entries[i].key, entries[i].hash)] = (int32_t)i;
+  }
+  reportResize(entries, entriesCapacity);
+  reportResize(indices, indicesCapacity);
+}
+
+const Value* ObjectMap::get(Value key) const {
+  if (count == 0) return nullptr;
+  int32_t entry = indices[findIndex(key, hashValue(key))];
+  return entry == EMPTY ? nullptr : &entries[entry].value;
+}
+
+void ObjectMap::set(Value key, Value value) {
+  size_t hash = hashValue(key);
+  if (!indices.empty()) {
+    int32_t entry = indices[findIndex(key, hash)];
+    if (entry != EMPTY) {
+      entries[entry].value = value;
+      return;
+    }
+  }
+
+  // tombstones count towards the load, so that probing always ends
+  if ((entries.size() + 1) * 4 > indices.size() * 3) {
+    size_t capacity = 8;
+    while ((count + 1) * 2 > capacity) capacity *= 2;
+    rebuild(capacity);
+  }
+
+  indices[findIndex(key, hash)] = (int32_t)entries.size();
+  size_t capacity = entries.capacity();
+  entries.push_back({key, value, hash});
+  reportResize(entries, capacity);
+  count++;
+}
+
+bool ObjectMap::remove(Value key, Value* removed) {
+  if (count == 0) return false;
+  size_t index = findIndex(key, hashValue(key));
+  int32_t entry = indices[index];
+  if (entry == EMPTY) return false;
+
+  *removed = entries[entry].value;
+  entries[entry].key = UNDEFINED_VAL;
+  entries[entry].value = NULL_VAL;
+  indices[index] = DELETED;
+  count--;
+  return true;
+}
+
+const std::vector<ObjectMap::Entry>& ObjectMap::getEntries() const {
+  return entries;
+}
+
+size_t ObjectMap::getCapacity() const { return indices.capacity(); }
+
+void ObjectMap::printMap() const {
+  std::cout << "{";
+  size_t printed = 0;
+  for (const Entry& entry : entries) {
+    if (IS_UNDEFINED(entry.key)) continue;
+    entry.key.printValue();
+    std::cout << ": ";
+    entry.value.printValue();
+    if (++printed != count) {
+      std::cout << ", ";
+    }
+  }
+  std::cout << "}";
+}
+
+size_t ObjectMap::size() const { return count; }
+
+ObjectPriorityQueue::ObjectPriorityQueue() : Object(OBJECT_PRIORITY_QUEUE) {}
+
+bool ObjectPriorityQueue::less(Value a, Value b) {
+  if (IS_NUM(a)) return AS_NUM(a) < AS_NUM(b);
+  return AS_STRING(a) < AS_STRING(b);
+}
+
+void ObjectPriorityQueue::push(Value key, Value value) {
+  size_t capacity = entries.capacity();
+  entries.push_back({key, value});
+  reportResize(entries, capacity);
+
+  size_t i = entries.size() - 1;
+  while (i != 0) {
+    size_t parent = (i - 1) / 2;
+    if (!less(entries[i].key, entries[parent].key)) break;
+    std::swap(entries[i], entries[parent]);
+    i = parent;
+  }
+}
+
+Value ObjectPriorityQueue::pop() {
+  Value min = entries.front().value;
+  entries.front() = entries.back();
+  entries.pop_back();
+
+  size_t i = 0;
+  while (true) {
+    size_t left = 2 * i + 1;
+    size_t right = 2 * i + 2;
+    size_t smallest = i;
+    if (left < entries.size() &&
+        less(entries[left].key, entries[smallest].key)) {
+      smallest = left;
+    }
+    if (right < entries.size() &&
+        less(entries[right].key, entries[smallest].key)) {
+      smallest = right;
+    }
+    if (smallest == i) break;
+    std::swap(entries[i], entries[smallest]);
+    i = smallest;
+  }
+  return min;
+}
+
+Value ObjectPriorityQueue::top() const { return entries.front().value; }
+
+const std::vector<ObjectPriorityQueue::Entry>&
+ObjectPriorityQueue::getEntries() const {
+  return entries;
+}
+
+size_t ObjectPriorityQueue::size() const { return entries.size(); }
+
+ObjectDeque::ObjectDeque() : Object(OBJECT_DEQUE) {}
+
+void ObjectDeque::grow() {
+  std::vector<Value> grown(buffer.empty() ? 8 : buffer.size() * 2);
+  for (size_t i = 0; i < count; i++) {
+    grown[i] = get(i);
+  }
+  size_t capacity = buffer.capacity();
+  buffer = std::move(grown);
+  head = 0;
+  reportResize(buffer, capacity);
+}
+
+void ObjectDeque::pushBack(Value v) {
+  if (count == buffer.size()) grow();
+  buffer[(head + count) & (buffer.size() - 1)] = v;
+  count++;
+}
+
+void ObjectDeque::pushFront(Value v) {
+  if (count == buffer.size()) grow();
+  head = (head - 1) & (buffer.size() - 1);
+  buffer[head] = v;
+  count++;
+}
+
+Value ObjectDeque::popBack() {
+  count--;
+  Value& slot = buffer[(head + count) & (buffer.size() - 1)];
+  Value v = slot;
+  slot = NULL_VAL;
+  return v;
+}
+
+Value ObjectDeque::popFront() {
+  Value v = buffer[head];
+  buffer[head] = NULL_VAL;
+  head = (head + 1) & (buffer.size() - 1);
+  count--;
+  return v;
+}
+
+Value ObjectDeque::get(size_t i) const {
+  return buffer[(head + i) & (buffer.size() - 1)];
+}
+
+void ObjectDeque::set(Value v, size_t i) {
+  buffer[(head + i) & (buffer.size() - 1)] = v;
+}
+
+void ObjectDeque::printDeque() const {
+  std::cout << "[";
+  for (size_t i = 0; i < count; i++) {
+    get(i).printValue();
+    if (i + 1 != count) {
+      std::cout << ", ";
+    }
+  }
+  std::cout << "]";
+}
+
+size_t ObjectDeque::size() const { return count; }
+
+size_t ObjectDeque::getCapacity() const { return buffer.size(); }
+
+ObjectRandom::ObjectRandom(uint64_t seed) : Object(OBJECT_RANDOM) {
+  for (uint64_t& word : state) {
+    seed += 0x9e3779b97f4a7c15;
+    uint64_t z = seed;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    word = z ^ (z >> 31);
+  }
+}
+
+static inline uint64_t rotateLeft(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+uint64_t ObjectRandom::next() {
+  uint64_t result = rotateLeft(state[1] * 5, 7) * 9;
+  uint64_t t = state[1] << 17;
+  state[2] ^= state[0];
+  state[3] ^= state[1];
+  state[1] ^= state[2];
+  state[0] ^= state[3];
+  state[2] ^= t;
+  state[3] = rotateLeft(state[3], 45);
+  return result;
+}
+
+double ObjectRandom::nextDouble() {
+  // the top 53 bits fill the mantissa exactly
+  return (next() >> 11) * 0x1.0p-53;
+}
+
+uint64_t ObjectRandom::nextBelow(uint64_t bound) {
+  // reject the values that would make the low results more likely
+  uint64_t threshold = -bound % bound;
+  while (true) {
+    uint64_t x = next();
+    if (x >= threshold) return x % bound;
+  }
+}
+
+ObjectStringBuilder::ObjectStringBuilder() : Object(OBJECT_STRING_BUILDER) {}
+
+void ObjectStringBuilder::reclaim() {
+  if (built == nullptr) return;
+  size_t capacity = buffer.capacity();
+  buffer = built->getString();
+  built = nullptr;
+  reportResize(buffer, capacity);
+}
+
+void ObjectStringBuilder::append(std::string_view text) {
+  reclaim();
+  size_t capacity = buffer.capacity();
+  buffer += text;
+  reportResize(buffer, capacity);
+}
+
+void ObjectStringBuilder::append(double number) {
+  reclaim();
+  size_t capacity = buffer.capacity();
+  // format straight into the end of the buffer
+  size_t length = buffer.size();
+  buffer.resize(length + NUMBER_TEXT_MAX);
+  buffer.resize(length + formatNumber(number, buffer.data() + length));
+  reportResize(buffer, capacity);
+}
+
+std::string ObjectStringBuilder::release() {
+  size_t capacity = buffer.capacity();
+  std::string contents = std::move(buffer);
+  buffer = std::string();
+  // the characters now belong to the string made from them
+  reportResize(buffer, capacity);
+  return contents;
+}
+
+void ObjectStringBuilder::setBuilt(ObjectString* string) { built = string; }
+
+std::string_view ObjectStringBuilder::getView() const {
+  return built == nullptr ? std::string_view(buffer) : built->getView();
+}
+
+size_t ObjectStringBuilder::getLength() const { return getView().size(); }
+
+size_t ObjectStringBuilder::getCapacity() const { return buffer.capacity(); }
+
+ObjectString* ObjectStringBuilder::getBuilt() const { return built; }
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) Andy Yu and Yunze Zhou
+ * Luminous implementation code written by Yunze Zhou and Andy Yu.
+ * Sharing and altering of the source code is restricted under the MIT License.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "object.hpp"
+#include "vm.hpp"
+
+// Random natives take the generator made by 'randomGenerator' as their first
+// argument. Integer ranges are half-open, like the ranges of a for loop.
+
+// returns true if the value is an integer a double can hold exactly
+static bool isExactInteger(Value value) {
+  if (!IS_NUM(value)) return false;
+  double number = AS_NUM(value);
+  return std::floor(number) == number && std::fabs(number) <= 0x1.0p53;
+}
+
+ObjectRandom* VM::randomArgument(const char* name, Value generator) {
+  if (!IS_RANDOM(generator)) {
+    runtimeError("Expect a random generator as first argument for '%s'.",
+                 name);
+  }
+  return AS_RANDOM(generator);
+}
+
+uint64_t VM::rangeSize(const char* name, Value low, Value high) {
+  if (!isExactInteger(low) || !isExactInteger(high)) {
+    runtimeError("Expect integer bounds for '%s'.", name);
+  }
+  if (AS_NUM(low) >= AS_NUM(high)) {
+    runtimeError("Expect the lower bound to be less than the upper bound for "
+                 "'%s'.",
+                 name);
+  }
+  return (uint64_t)(AS_NUM(high) - AS_NUM(low));
+}
+
+Value VM::randomGeneratorNative(VM& vm, std::span<Value> args) {
+  uint64_t seed;
+  if (args.size() == 0) {
+    seed = std::chrono::steady_clock::now().time_since_epoch().count();
+  } else {
+    Value arg = args[0];
+    if (!isExactInteger(arg)) {
+      vm.runtimeError("Expect an integer seed for 'randomGenerator'.");
+    }
+    seed = (uint64_t)(int64_t)AS_NUM(arg);
+  }
+  return OBJECT_VAL(heap.allocate<ObjectRandom>(seed));
+}
+
+Value VM::nextIntNative(VM& vm, std::span<Value> args) {
+  ObjectRandom* generator = vm.randomArgument("nextInt", args[0]);
+  Value low = args[1];
+  uint64_t size = vm.rangeSize("nextInt", low, args[2]);
+  return NUM_VAL(AS_NUM(low) + (double)generator->nextBelow(size));
+}
+
+Value VM::nextFloatNative(VM& vm, std::span<Value> args) {
+  return NUM_VAL(vm.randomArgument("nextFloat", args[0])->nextDouble());
+}
+
+Value VM::shuffleNative(VM& vm, std::span<Value> args) {
+  ObjectRandom* generator = vm.randomArgument("shuffle", args[0]);
+  Value list = args[1];
+  if (!IS_LIST(list)) {
+    vm.runtimeError("Expect a list as second argument for 'shuffle'.");
+  }
+
+  // Fisher-Yates, in place
+  ObjectList* actualList = AS_OBJECTLIST(list);
+  for (size_t i = actualList->size(); i > 1; i--) {
+    size_t j = generator->nextBelow(i);
+    Value swapped = actualList->get(i - 1);
+    actualList->set(actualList->get(j), i - 1);
+    actualList->set(swapped, j);
+  }
+  return list;
+}
+
+Value VM::fillNative(VM& vm, std::span<Value> args) {
+  if (args.size() == 3) {
+    vm.runtimeError("Expect 2 or 4 arguments for 'fill', but found 3.");
+  }
+  ObjectRandom* generator = vm.randomArgument("fill", args[0]);
+  Value count = args[1];
+  if (!isExactInteger(count) || AS_NUM(count) < 0) {
+    vm.runtimeError("Expect a non-negative integer count for 'fill'.");
+  }
+
+  std::vector<Value> values;
+  if (AS_NUM(count) > (double)values.max_size()) {
+    vm.runtimeError("Count is too large for 'fill'.");
+  }
+  // a count below max_size() can still need more memory than there is
+  try {
+    values.resize((size_t)AS_NUM(count));
+  } catch (const std::bad_alloc&) {
+    vm.runtimeError("Not enough memory to fill %.0f numbers.", AS_NUM(count));
+  }
+
+  if (args.size() == 2) {
+    for (Value& value : values) {
+      value = NUM_VAL(generator->nextDouble());
+    }
+  } else {
+    Value low = args[2];
+    uint64_t size = vm.rangeSize("fill", low, args[3]);
+    double offset = AS_NUM(low);
+    for (Value& value : values) {
+      value = NUM_VAL(offset + (double)generator->nextBelow(size));
+    }
+  }
+  return OBJECT_VAL(heap.allocate<ObjectList>(std::move(values)));
+}
+
+void VM::defineRandomNatives() {
+  defineNative("randomGenerator", randomGeneratorNative, 0, 1);
+  defineNative("nextInt", nextIntNative, 3);
+  defineNative("nextFloat", nextFloatNative, 1);
+  defineNative("shuffle", shuffleNative, 2);
+  defineNative("fill", fillNative, 2, 4);
+}
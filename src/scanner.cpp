@@ -207,6 +207,9 @@ void Scanner::scanToken() {
     case ';':
       addToken(TOKEN_SEMI);
       break;
+    case ':':
+      addToken(TOKEN_COLON);
+      break;
     case '%':
       if (match('=')) {
         addToken(TOKEN_PERCBECOMES);
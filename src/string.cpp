@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) Andy Yu and Yunze Zhou
+ * Luminous implementation code written by Yunze Zhou and Andy Yu.
+ * Sharing and altering of the source code is restricted under the MIT License.
+ */
+
+#include <cmath>
+#include <new>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "object.hpp"
+#include "vm.hpp"
+
+// String natives work on std::string_view, whose searches are built on
+// memchr and memcmp, so scanning a string runs at the speed of the C library
+// instead of one opcode per character. Slices are read in place.
+
+static constexpr std::string_view WHITESPACE = " \t\n\r\f\v";
+
+ObjectString* VM::substringOf(ObjectString* source, size_t begin,
+                              size_t end) {
+  if (begin == 0 && end == source->getLength()) return source;
+  if (end - begin < SLICE_MIN_LENGTH) {
+    return heap.intern(source->getView().substr(begin, end - begin));
+  }
+  return heap.allocate<ObjectString>(source, begin, end - begin);
+}
+
+ObjectString* VM::stringArgument(const char* name, Value value) {
+  if (!IS_STRING(value)) {
+    runtimeError("Expect strings as arguments for '%s'.", name);
+  }
+  return AS_OBJECTSTRING(value);
+}
+
+size_t VM::countArgument(const char* name, Value value) {
+  if (!IS_NUM(value) || AS_NUM(value) < 0 ||
+      std::floor(AS_NUM(value)) != AS_NUM(value)) {
+    runtimeError("Expect a non-negative integer as argument for '%s'.", name);
+  }
+  return (size_t)AS_NUM(value);
+}
+
+// returns the position as a number, -1 if nothing was found
+static Value positionValue(size_t position) {
+  return NUM_VAL(position == std::string_view::npos ? -1 : (double)position);
+}
+
+Value VM::indexOfNative(VM& vm, std::span<Value> args) {
+  std::string_view string = vm.stringArgument("indexOf", args[0])->getView();
+  std::string_view pattern = vm.stringArgument("indexOf", args[1])->getView();
+  size_t from = args.size() == 3 ? vm.countArgument("indexOf", args[2]) : 0;
+  return positionValue(string.find(pattern, from));
+}
+
+Value VM::lastIndexOfNative(VM& vm, std::span<Value> args) {
+  std::string_view string =
+      vm.stringArgument("lastIndexOf", args[0])->getView();
+  std::string_view pattern =
+      vm.stringArgument("lastIndexOf", args[1])->getView();
+  return positionValue(string.rfind(pattern));
+}
+
+Value VM::containsNative(VM& vm, std::span<Value> args) {
+  std::string_view string = vm.stringArgument("contains", args[0])->getView();
+  std::string_view pattern = vm.stringArgument("contains", args[1])->getView();
+  return BOOL_VAL(string.find(pattern) != std::string_view::npos);
+}
+
+Value VM::startsWithNative(VM& vm, std::span<Value> args) {
+  std::string_view string =
+      vm.stringArgument("startsWith", args[0])->getView();
+  std::string_view prefix =
+      vm.stringArgument("startsWith", args[1])->getView();
+  return BOOL_VAL(string.starts_with(prefix));
+}
+
+Value VM::endsWithNative(VM& vm, std::span<Value> args) {
+  std::string_view string = vm.stringArgument("endsWith", args[0])->getView();
+  std::string_view suffix = vm.stringArgument("endsWith", args[1])->getView();
+  return BOOL_VAL(string.ends_with(suffix));
+}
+
+Value VM::splitNative(VM& vm, std::span<Value> args) {
+  ObjectString* source = vm.stringArgument("split", args[0]);
+  std::string_view separator = vm.stringArgument("split", args[1])->getView();
+  std::string_view string = source->getView();
+
+  // an empty separator splits the string into its characters
+  std::vector<Value> pieces;
+  if (separator.empty()) {
+    pieces.reserve(string.size());
+    for (size_t i = 0; i < string.size(); i++) {
+      pieces.push_back(OBJECT_VAL(heap.intern(string.substr(i, 1))));
+    }
+    return OBJECT_VAL(heap.allocate<ObjectList>(std::move(pieces)));
+  }
+
+  size_t begin = 0;
+  while (true) {
+    size_t end = string.find(separator, begin);
+    if (end == std::string_view::npos) end = string.size();
+    ObjectString* piece =
+        begin == end ? heap.intern("") : substringOf(source, begin, end);
+    pieces.push_back(OBJECT_VAL(piece));
+    if (end == string.size()) break;
+    begin = end + separator.size();
+  }
+  return OBJECT_VAL(heap.allocate<ObjectList>(std::move(pieces)));
+}
+
+Value VM::joinNative(VM& vm, std::span<Value> args) {
+  if (!IS_LIST(args[0])) {
+    vm.runtimeError("Expect a list as first argument for 'join'.");
+  }
+  ObjectList* list = AS_OBJECTLIST(args[0]);
+  std::string_view separator = vm.stringArgument("join", args[1])->getView();
+
+  std::string joined;
+  for (size_t i = 0; i < list->size(); i++) {
+    if (i != 0) joined += separator;
+    Value item = list->get(i);
+    if (IS_STRING(item)) {
+      joined += AS_OBJECTSTRING(item)->getView();
+    } else if (IS_NUM(item)) {
+      char text[NUMBER_TEXT_MAX];
+      joined.append(text, formatNumber(AS_NUM(item), text));
+    } else {
+      vm.runtimeError("Expect a list of strings or numbers for 'join'.");
+    }
+  }
+  return OBJECT_VAL(heap.intern(joined));
+}
+
+Value VM::replaceNative(VM& vm, std::span<Value> args) {
+  ObjectString* source = vm.stringArgument("replace", args[0]);
+  std::string_view pattern = vm.stringArgument("replace", args[1])->getView();
+  std::string_view replacement =
+      vm.stringArgument("replace", args[2])->getView();
+  if (pattern.empty()) {
+    vm.runtimeError("Cannot replace an empty string.");
+  }
+
+  std::string_view string = source->getView();
+  size_t found = string.find(pattern);
+  if (found == std::string_view::npos) return OBJECT_VAL(source);
+
+  std::string replaced;
+  replaced.reserve(string.size());
+  size_t begin = 0;
+  while (found != std::string_view::npos) {
+    replaced.append(string, begin, found - begin);
+    replaced += replacement;
+    begin = found + pattern.size();
+    found = string.find(pattern, begin);
+  }
+  replaced.append(string, begin);
+  return OBJECT_VAL(heap.intern(replaced));
+}
+
+Value VM::trimNative(VM& vm, std::span<Value> args) {
+  ObjectString* source = vm.stringArgument("trim", args[0]);
+  std::string_view string = source->getView();
+  size_t begin = string.find_first_not_of(WHITESPACE);
+  if (begin == std::string_view::npos) return OBJECT_VAL(heap.intern(""));
+  size_t end = string.find_last_not_of(WHITESPACE) + 1;
+  return OBJECT_VAL(substringOf(source, begin, end));
+}
+
+// changes the case of ASCII letters only, without branches so that the loop
+// can be vectorized
+static void changeCase(std::string& string, char first) {
+  for (char& c : string) {
+    c ^= (unsigned char)(c - first) < 26 ? 0x20 : 0;
+  }
+}
+
+Value VM::toUpperNative(VM& vm, std::span<Value> args) {
+  std::string string(vm.stringArgument("toUpper", args[0])->getView());
+  changeCase(string, 'a');
+  return OBJECT_VAL(heap.intern(string));
+}
+
+Value VM::toLowerNative(VM& vm, std::span<Value> args) {
+  std::string string(vm.stringArgument("toLower", args[0])->getView());
+  changeCase(string, 'A');
+  return OBJECT_VAL(heap.intern(string));
+}
+
+Value VM::repeatNative(VM& vm, std::span<Value> args) {
+  std::string_view string = vm.stringArgument("repeat", args[0])->getView();
+  size_t count = vm.countArgument("repeat", args[1]);
+  if (string.empty()) return args[0];
+
+  std::string repeated;
+  if (count > repeated.max_size() / string.size()) {
+    vm.runtimeError("Result is too long for 'repeat'.");
+  }
+  // a length below max_size() can still need more memory than there is
+  try {
+    repeated.reserve(string.size() * count);
+  } catch (const std::bad_alloc&) {
+    vm.runtimeError("Not enough memory to repeat a string %zu times.", count);
+  }
+  for (size_t i = 0; i < count; i++) {
+    repeated += string;
+  }
+  return OBJECT_VAL(heap.intern(repeated));
+}
+
+ObjectStringBuilder* VM::builderArgument(const char* name, Value builder) {
+  if (!IS_STRING_BUILDER(builder)) {
+    runtimeError("Expect a string builder as first argument for '%s'.", name);
+  }
+  return AS_STRING_BUILDER(builder);
+}
+
+ObjectString* VM::builtString(ObjectStringBuilder* builder) {
+  if (builder->getBuilt() == nullptr) {
+    builder->setBuilt(heap.allocate<ObjectString>(builder->release()));
+  }
+  return builder->getBuilt();
+}
+
+void VM::appendValue(ObjectStringBuilder* builder, Value value) {
+  if (IS_STRING(value)) {
+    builder->append(AS_OBJECTSTRING(value)->getView());
+  } else if (IS_NUM(value)) {
+    builder->append(AS_NUM(value));
+  } else {
+    // anything else is appended the way print shows it
+    builder->append(printedText(value));
+  }
+}
+
+Value VM::stringBuilderNative(VM&, std::span<Value> args) {
+  ObjectStringBuilder* builder = heap.allocate<ObjectStringBuilder>();
+  if (args.size() == 1) appendValue(builder, args[0]);
+  return OBJECT_VAL(builder);
+}
+
+Value VM::appendNative(VM& vm, std::span<Value> args) {
+  appendValue(vm.builderArgument("append", args[0]), args[1]);
+  return args[0];
+}
+
+Value VM::appendLineNative(VM& vm, std::span<Value> args) {
+  ObjectStringBuilder* builder = vm.builderArgument("appendLine", args[0]);
+  if (args.size() == 2) appendValue(builder, args[1]);
+  builder->append("\n");
+  return args[0];
+}
+
+void VM::defineStringNatives() {
+  defineNative("indexOf", indexOfNative, 2, 3);
+  defineNative("lastIndexOf", lastIndexOfNative, 2);
+  defineNative("contains", containsNative, 2);
+  defineNative("startsWith", startsWithNative, 2);
+  defineNative("endsWith", endsWithNative, 2);
+  defineNative("split", splitNative, 2);
+  defineNative("join", joinNative, 2);
+  defineNative("replace", replaceNative, 3);
+  defineNative("trim", trimNative, 1);
+  defineNative("toUpper", toUpperNative, 1);
+  defineNative("toLower", toLowerNative, 1);
+  defineNative("repeat", repeatNative, 2);
+  defineNative("stringBuilder", stringBuilderNative, 0, 1);
+  defineNative("append", appendNative, 2);
+  defineNative("appendLine", appendLineNative, 1, 2);
+}
@@ -6,51 +6,41 @@
 
 #include "value.hpp"
 
+#include <charconv>
+#include <cmath>
 #include <iostream>
 
 #include "object.hpp"
 
-Value::Value(ValueType type,
-             std::variant<bool, double, std::shared_ptr<Object>> as)
-    : type{type}, as{as} {}
-
-Value::Value(const Value& value) : type{value.type}, as{value.as} {}
+ValueType Value::getType() const {
+  if (isNum()) return VAL_NUM;
+  if (isBool()) return VAL_BOOL;
+  if (isNull()) return VAL_NULL;
+  return VAL_OBJECT;
+}
 
 bool Value::operator==(const Value& compared) const {
-  if (type != compared.type) return false;
-
-  switch (type) {
-    case VAL_BOOL: {
-      return AS_BOOL(*this) == AS_BOOL(compared);
-    }
-    case VAL_NULL: {
-      return true;
-    }
-    case VAL_NUM: {
-      return AS_NUM(*this) == AS_NUM(compared);
-    }
-    case VAL_OBJECT: {
-      const std::string& a = AS_STRING(*this);
-      const std::string& b = AS_STRING(compared);
-      return a == b;
-    }
-    default: {
-      return false;  // unreachable
-    }
+  if (IS_NUM(*this) && IS_NUM(compared)) {
+    return AS_NUM(*this) == AS_NUM(compared);
   }
-}
+  if (bits == compared.bits) return true;
 
-Value& Value::operator=(Value other) {
-  type = other.type;
-  as = other.as;
-  return *this;
+  // other objects are compared by identity, and so are interned strings.
+  // Ropes and the strings flattened from them are compared by content.
+  if (IS_STRING(*this) && IS_STRING(compared)) {
+    return ObjectString::Comparator{}(AS_OBJECTSTRING(*this),
+                                      AS_OBJECTSTRING(compared));
+  }
+  return false;
 }
 
 void Value::printValue() const {
-  switch (type) {
-    case VAL_NUM:
-      std::cout << AS_NUM(*this);
+  switch (getType()) {
+    case VAL_NUM: {
+      char text[NUMBER_TEXT_MAX];
+      std::cout.write(text, formatNumber(AS_NUM(*this), text));
       break;
+    }
     case VAL_BOOL:
       std::cout << std::boolalpha << AS_BOOL(*this);
       break;
@@ -63,8 +53,19 @@ void Value::printValue() const {
   }
 }
 
-ValueType Value::getType() const { return type; }
+size_t formatNumber(double number, char* text) {
+  char* end = text + NUMBER_TEXT_MAX;
+  // an integer a double holds exactly keeps all its digits, where the
+  // shortest form would write 300000 as 3e+05
+  std::to_chars_result result =
+      std::floor(number) == number && std::fabs(number) < 0x1.0p53
+          ? std::to_chars(text, end, number, std::chars_format::fixed)
+          : std::to_chars(text, end, number);
+  return result.ptr - text;
+}
 
-std::variant<bool, double, std::shared_ptr<Object>> Value::getAs() const {
-  return as;
+bool parseNumber(std::string_view text, double& number) {
+  const char* end = text.data() + text.size();
+  auto result = std::from_chars(text.data(), end, number);
+  return result.ec == std::errc() && result.ptr == end;
 }
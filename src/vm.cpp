@@ -6,6 +6,7 @@
 
 #include "vm.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <cstdarg>
 #include <cstdio>
@@ -15,37 +16,92 @@
 #include <string>
 
 #include "chunk.hpp"
+#include "globals.hpp"
 #include "object.hpp"
 
 #ifdef DEBUG
 #include "debug.hpp"
 #endif
 
-VM::VM() {
-  defineNative("clock", std::bind(&VM::clockNative, this, std::placeholders::_1,
-                                  std::placeholders::_2));
-  defineNative("substring",
-               std::bind(&VM::substringNative, this, std::placeholders::_1,
-                         std::placeholders::_2));
-  defineNative("size", std::bind(&VM::sizeNative, this, std::placeholders::_1,
-                                 std::placeholders::_2));
-  defineNative("floor", std::bind(&VM::floorNative, this, std::placeholders::_1,
-                                  std::placeholders::_2));
-  defineNative("ceil", std::bind(&VM::ceilNative, this, std::placeholders::_1,
-                                 std::placeholders::_2));
-  defineNative("type", std::bind(&VM::typeNative, this, std::placeholders::_1,
-                                 std::placeholders::_2));
-  defineNative("throw", std::bind(&VM::throwNative, this, std::placeholders::_1,
-                                  std::placeholders::_2));
+// returns true if value is a finite whole number
+static bool isInteger(Value value) {
+  return IS_NUM(value) && std::isfinite(AS_NUM(value)) &&
+         std::floor(AS_NUM(value)) == AS_NUM(value);
 }
 
-Value MemoryStack::getValueAt(size_t index) const { return c[index]; }
+VM::VM() : stdoutBuffer{std::cout.rdbuf(&output)} {
+  heap.setVM(this);
+  frames.reserve(FRAMES_MAX);
+  defineNative("clock", clockNative, 0);
+  defineNative("flush", flushNative, 0);
+  defineNative("toString", toStringNative, 1);
+  defineNative("parseNumber", parseNumberNative, 1);
+  defineNative("substring", substringNative, 3);
+  defineNative("size", sizeNative, 1);
+  defineNative("floor", floorNative, 1);
+  defineNative("ceil", ceilNative, 1);
+  defineNative("isInteger", isIntegerNative, 1);
+  defineNative("type", typeNative, 1);
+  defineNative("throw", throwNative, 1);
+  defineNative("push", pushNative, 2);
+  defineNative("pop", popNative, 1);
+  defineNative("insert", insertNative, 3);
+  defineNative("removeAt", removeAtNative, 2);
+  defineNative("keys", keysNative, 1);
+  defineNative("values", valuesNative, 1);
+  defineNative("hasKey", hasKeyNative, 2);
+  defineNative("remove", removeNative, 2);
+  defineNative("priorityQueue", priorityQueueNative, 0);
+  defineNative("heapPush", heapPushNative, 3);
+  defineNative("heapPop", heapPopNative, 1);
+  defineNative("heapTop", heapTopNative, 1);
+  defineNative("deque", dequeNative, 0);
+  defineNative("pushFront", pushFrontNative, 2);
+  defineNative("popFront", popFrontNative, 1);
+  defineMathNatives();
+  defineRandomNatives();
+  defineStringNatives();
+
+  sizeIntrinsic = makeIntrinsic("size");
+  typeIntrinsic = makeIntrinsic("type");
+  isIntegerIntrinsic = makeIntrinsic("isInteger");
+  floorIntrinsic = makeIntrinsic("floor");
+  ceilIntrinsic = makeIntrinsic("ceil");
+}
+
+VM::~VM() {
+  std::cout.flush();
+  std::cout.rdbuf(stdoutBuffer);
+}
 
-Value* MemoryStack::getValuePtrAt(size_t index) const {
-  return (Value*)&(c[index]);
+OutputBuffer::OutputBuffer()
+    : buffer(std::make_unique<char[]>(OUTPUT_BUFFER_SIZE)) {
+  setp(buffer.get(), buffer.get() + OUTPUT_BUFFER_SIZE);
 }
 
-void MemoryStack::setValueAt(Value value, size_t index) { c[index] = value; }
+OutputBuffer::int_type OutputBuffer::overflow(int_type c) {
+  if (sync() != 0) return traits_type::eof();
+  if (!traits_type::eq_int_type(c, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(c);
+    pbump(1);
+  }
+  return traits_type::not_eof(c);
+}
+
+int OutputBuffer::sync() {
+  size_t size = pptr() - pbase();
+  if (size != 0 && std::fwrite(pbase(), 1, size, stdout) != size) return -1;
+  setp(buffer.get(), buffer.get() + OUTPUT_BUFFER_SIZE);
+  return std::fflush(stdout) == 0 ? 0 : -1;
+}
+
+MemoryStack::MemoryStack()
+    : values(std::make_unique<Value[]>(STACK_MAX)), stackTop(values.get()) {}
+
+void MemoryStack::duplicate(size_t count) {
+  std::copy(stackTop - count, stackTop, stackTop);
+  stackTop += count;
+}
 
 void VM::binaryOperation(char operation) {
   Value a = memory.top();
@@ -83,29 +139,24 @@ void VM::binaryOperation(char operation) {
         throw VMException();  // unreachable
     }
   } else if (IS_STRING(a) && IS_STRING(b)) {
-    const std::string& c = AS_STRING(a);
-    const std::string& d = AS_STRING(b);
-
     switch (operation) {
       case '+':
-        concatenate(c, d);
+        concatenate(AS_OBJECTSTRING(b), AS_OBJECTSTRING(a));
         break;
       case '>':
-        memory.push(BOOL_VAL(d > c));
+        memory.push(BOOL_VAL(AS_STRING(b) > AS_STRING(a)));
         break;
       case '<':
-        memory.push(BOOL_VAL(d < c));
+        memory.push(BOOL_VAL(AS_STRING(b) < AS_STRING(a)));
         break;
       default:
         std::string symbol(1, operation);
         runtimeError("Invalid operation '%s' on strings.", symbol.c_str());
     }
   } else if (IS_STRING(b) && IS_NUM(a)) {
-    const std::string& c = AS_STRING(b);
-    double d = AS_NUM(a);
     switch (operation) {
       case '+':
-        concatenate(c, d);
+        concatenate(AS_OBJECTSTRING(b), AS_NUM(a));
         break;
       default:
         std::string symbol(1, operation);
@@ -115,13 +166,13 @@ void VM::binaryOperation(char operation) {
   } else if (IS_LIST(b)) {
     switch (operation) {
       case '+': {
-        std::shared_ptr<ObjectList> curList = AS_OBJECTLIST(b);
+        ObjectList* curList = AS_OBJECTLIST(b);
         std::vector<Value> newList;
         for (unsigned i = 0; i < curList->size(); i++) {
           newList.push_back(curList->get(i));
         }
         newList.push_back(a);
-        memory.push(OBJECT_VAL(std::make_shared<ObjectList>(newList)));
+        memory.push(OBJECT_VAL(heap.allocate<ObjectList>(newList)));
         break;
       }
       case '-': {
@@ -135,7 +186,7 @@ void VM::binaryOperation(char operation) {
         if (std::floor(index) != std::ceil(index)) {
           runtimeError("Index must be a positive integer");
         }
-        std::shared_ptr<ObjectList> curList = AS_OBJECTLIST(b);
+        ObjectList* curList = AS_OBJECTLIST(b);
         if (index >= curList->size()) {
           runtimeError("Index out of bounds.");
         }
@@ -144,7 +195,7 @@ void VM::binaryOperation(char operation) {
           newList.push_back(curList->get(i));
         }
         newList.erase(newList.begin() + (unsigned)index);
-        memory.push(OBJECT_VAL(std::make_shared<ObjectList>(newList)));
+        memory.push(OBJECT_VAL(heap.allocate<ObjectList>(newList)));
         break;
       }
       case '*': {
@@ -158,7 +209,7 @@ void VM::binaryOperation(char operation) {
         if (std::floor(mult) != std::ceil(mult)) {
           runtimeError("Multiplier must be a positive integer");
         }
-        std::shared_ptr<ObjectList> curList = AS_OBJECTLIST(b);
+        ObjectList* curList = AS_OBJECTLIST(b);
         std::vector<Value> newList;
         for (unsigned i = 0; i < curList->size(); i++) {
           newList.push_back(curList->get(i));
@@ -169,7 +220,7 @@ void VM::binaryOperation(char operation) {
                                    newList.end());
         }
         memory.push(
-            OBJECT_VAL(std::make_shared<ObjectList>(newDuplicatedList)));
+            OBJECT_VAL(heap.allocate<ObjectList>(newDuplicatedList)));
         break;
       }
       default: {
@@ -183,9 +234,58 @@ void VM::binaryOperation(char operation) {
   }
 }
 
-void VM::resetMemory() { memory = MemoryStack(); }
+void VM::resetMemory() {
+  memory.reset();
+  frames.clear();
+  openUpvalues = nullptr;
+}
+
+void VM::setLineBuffered(bool lineBuffered) {
+  this->lineBuffered = lineBuffered;
+}
+
+void VM::markRoots() {
+  for (size_t i = 0; i < memory.size(); i++) {
+    heap.markValue(memory.getValueAt(i));
+  }
+
+  for (const CallFrame& frame : frames) {
+    heap.markObject(frame.closure);
+  }
+
+  for (size_t i = 0; i < globalTable.size(); i++) {
+    heap.markObject(globalTable.getName(i));
+  }
+  for (Value value : globals) {
+    heap.markValue(value);
+  }
+
+  for (ObjectUpvalue* upvalue = openUpvalues; upvalue != nullptr;
+       upvalue = upvalue->next) {
+    heap.markObject(upvalue);
+  }
+
+  heap.markObject(constructorString);
+  for (ObjectString* name :
+       {typeNames.number, typeNames.boolean, typeNames.null,
+        typeNames.objClass, typeNames.function, typeNames.list, typeNames.map,
+        typeNames.priorityQueue, typeNames.deque, typeNames.random,
+        typeNames.stringBuilder, typeNames.string, typeNames.unknown}) {
+    heap.markObject(name);
+  }
+
+  // a replaced native must stay alive, or another object could take its
+  // address and pass for it
+  for (const Intrinsic* intrinsic :
+       {&sizeIntrinsic, &typeIntrinsic, &isIntegerIntrinsic, &floorIntrinsic,
+        &ceilIntrinsic}) {
+    heap.markObject(intrinsic->native);
+  }
+}
 
 void VM::runtimeError(const char* format, ...) {
+  // whatever the script printed so far comes before the error
+  std::cout.flush();
 #ifdef DEBUG
   printStack(memory);
 #endif
@@ -194,395 +294,670 @@ void VM::runtimeError(const char* format, ...) {
   vfprintf(stderr, format, args);
   va_end(args);
   fputs("\n", stderr);
+  throw VMException();
+}
 
+void VM::unwindStack() {
   while (!frames.empty()) {
-    CallFrame& frame = frames.top();
-    ObjectFunction& function = *(frame.closure.getFunction());
+    CallFrame& frame = frames.back();
+    ObjectFunction& function = *(frame.closure->getFunction());
+    Chunk& chunk = function.getChunk();
+    size_t offset = frame.ip - chunk.getCode() - 1;
 
-    std::cerr << "[line "
-              << function.getChunk().getBytecodeAt(frame.PC - 1).line
-              << " in file "
-              << function.getChunk().getBytecodeAt(frame.PC - 1).filename
-              << "] in ";
+    std::cerr << "[line " << chunk.getLineAt(offset) << " in file "
+              << chunk.getFilenameAt(offset) << "] in ";
 
     if (function.getName() == nullptr) {
       std::cerr << "script" << std::endl;
     } else {
       std::cerr << function.getName()->getString() << "()" << std::endl;
     }
-    frames.pop();
+    frames.pop_back();
   }
 
   std::cerr << "(Runtime Error)" << std::endl;
   resetMemory();
-  throw VMException();
 }
 
-void VM::interpret(std::shared_ptr<ObjectFunction> function) {
-  std::shared_ptr<ObjectClosure> closure =
-      std::make_shared<ObjectClosure>(function);
+void VM::interpret(ObjectFunction* function) {
+  ObjectClosure* closure = heap.allocate<ObjectClosure>(function);
   memory.push(OBJECT_VAL(closure));
+  // make room for the globals the compiler has resolved so far
+  globals.resize(globalTable.size(), UNDEFINED_VAL);
   callValue(OBJECT_VAL(closure), 0);
   run();
 }
 
 void VM::run() {
-  CallFrame* frame = &(frames.top());
-  while (true) {
-    switch (readByte()) {
-      case OP_CONSTANT: {
-        Value constant = getTopChunk().getConstantAt(readByte());
-        memory.push(constant);
-        break;
-      }
-      case OP_NULL: {
-        memory.push(NULL_VAL);
-        break;
-      }
-      case OP_TRUE: {
-        memory.push(BOOL_VAL(true));
-        break;
-      }
-      case OP_FALSE: {
-        memory.push(BOOL_VAL(false));
-        break;
-      }
-      case OP_POP: {
-        memory.pop();
-        break;
-      }
-      case OP_GET_LOCAL: {
-        uint8_t slot = readByte();
-        memory.push(memory.getValueAt(slot + frame->stackPos));
-        break;
-      }
-      case OP_SET_LOCAL: {
-        uint8_t slot = readByte();
-        memory.setValueAt(memory.top(), slot + frame->stackPos);
-        break;
-      }
-      case OP_GET_GLOBAL: {
-        Value constantName = readConstant();
-        std::shared_ptr<ObjectString> name = AS_OBJECTSTRING(constantName);
-        auto it = globals.find(name);
-        if (it == globals.end()) {
-          runtimeError("Undefined variable '%s'.", name->getString().c_str());
-        }
-        memory.push(it->second);
-        break;
-      }
-      case OP_SET_GLOBAL: {
-        Value constantName = readConstant();
-        std::shared_ptr<ObjectString> name = AS_OBJECTSTRING(constantName);
-        globals.insert_or_assign(name, memory.top());
-        break;
-      }
-      case OP_GET_PROPERTY: {
-        if (!IS_INSTANCE(memory.top())) {
-          runtimeError("Only instances have properties.");
-        }
+  // the current frame's state is kept in locals and only reloaded when the
+  // frame changes
+  CallFrame* frame;
+  uint8_t* ip;
+  const Value* constants;
+  InlineCache* caches;
+  Value* slots;
+
+#define LOAD_FRAME()                                            \
+  do {                                                          \
+    frame = &(frames.back());                                   \
+    ip = frame->ip;                                             \
+    Chunk& chunk = frame->closure->getFunction()->getChunk();   \
+    constants = chunk.getConstants();                           \
+    caches = chunk.getInlineCaches();                           \
+    slots = memory.getValuePtrAt(frame->stackPos);              \
+  } while (false)
+#define READ_BYTE() (*ip++)
+#define READ_SHORT() (ip += 2, (uint16_t)((ip[-2] << 8) | ip[-1]))
+#define READ_CONSTANT() (constants[READ_BYTE()])
+
+  // An arithmetic or comparison site that sees two numbers rewrites its
+  // opcode into the number-only variant. The variant checks its operands
+  // and turns the site back into the generic opcode when they are not both
+  // numbers anymore.
+#define NUM_OPERANDS() (IS_NUM(memory.top()) && IS_NUM(memory.peek(1)))
+#define BINARY_NUM(expression)           \
+  do {                                   \
+    double right = AS_NUM(memory.top()); \
+    memory.pop();                        \
+    double left = AS_NUM(memory.top());  \
+    memory.top() = expression;           \
+  } while (false)
+#define QUICKEN_BINARY(numOp, expression, operation) \
+  if (NUM_OPERANDS()) {                              \
+    ip[-1] = numOp;                                  \
+    BINARY_NUM(expression);                          \
+  } else {                                           \
+    binaryOperation(operation);                      \
+  }
+  // An intrinsic site evaluates expression on its single argument when the
+  // built-in is still in place, and falls back to a regular call otherwise.
+#define INTRINSIC(intrinsic, expression)        \
+  do {                                          \
+    const int argCount = READ_BYTE();           \
+    if (argCount == 1 && isIntact(intrinsic)) { \
+      Value arg = memory.top();                 \
+      memory.top() = expression;                \
+    } else {                                    \
+      frame->ip = ip;                           \
+      callIntrinsicGlobal(intrinsic, argCount); \
+      LOAD_FRAME();                             \
+    }                                           \
+  } while (false)
+#define GUARD_BINARY(genericOp, expression, operation) \
+  if (NUM_OPERANDS()) {                                \
+    BINARY_NUM(expression);                            \
+  } else {                                             \
+    ip[-1] = genericOp;                                \
+    binaryOperation(operation);                        \
+  }
 
-        ObjectInstance& instance = *(AS_INSTANCE(memory.top()));
-        std::shared_ptr<ObjectString> name = AS_OBJECTSTRING(readConstant());
-        validateAccessModifier(name, instance);
-        const Value* value = instance.getField(name);
-        if (value != nullptr) {
+#ifdef COMPUTED_GOTO
+  // one label per opcode, in the order of the OpCode enum
+  static void* dispatchTable[] = {
+      &&label_OP_CONSTANT,
+      &&label_OP_NULL,
+      &&label_OP_TRUE,
+      &&label_OP_FALSE,
+      &&label_OP_POP,
+      &&label_OP_GET_LOCAL,
+      &&label_OP_SET_LOCAL,
+      &&label_OP_GET_GLOBAL,
+      &&label_OP_SET_GLOBAL,
+      &&label_OP_GET_UPVALUE,
+      &&label_OP_SET_UPVALUE,
+      &&label_OP_GET_PROPERTY,
+      &&label_OP_SET_PROPERTY,
+      &&label_OP_GET_SUPER,
+      &&label_OP_EQUAL,
+      &&label_OP_GREATER,
+      &&label_OP_LESS,
+      &&label_OP_ADD,
+      &&label_OP_SUBSTRACT,
+      &&label_OP_MULTIPLY,
+      &&label_OP_DIVIDE,
+      &&label_OP_MODULO,
+      &&label_OP_NOT,
+      &&label_OP_NEGATE,
+      &&label_OP_PRINT,
+      &&label_OP_JUMP,
+      &&label_OP_JUMP_IF_FALSE,
+      &&label_OP_LOOP,
+      &&label_OP_CALL,
+      &&label_OP_INVOKE,
+      &&label_OP_SUPER_INVOKE,
+      &&label_OP_CLOSURE,
+      &&label_OP_CLOSE_UPVALUE,
+      &&label_OP_RETURN,
+      &&label_OP_METHOD,
+      &&label_OP_CLASS,
+      &&label_OP_INHERIT,
+      &&label_OP_ARRAY,
+      &&label_OP_ARRAY_SET,
+      &&label_OP_ARRAY_GET,
+      &&label_OP_MAP,
+      &&label_OP_DUPLICATE,
+      &&label_OP_FIELD,
+      &&label_OP_GREATER_NUM,
+      &&label_OP_LESS_NUM,
+      &&label_OP_ADD_NUM,
+      &&label_OP_SUBSTRACT_NUM,
+      &&label_OP_MULTIPLY_NUM,
+      &&label_OP_DIVIDE_NUM,
+      &&label_OP_MODULO_NUM,
+      &&label_OP_SIZE,
+      &&label_OP_TYPEOF,
+      &&label_OP_IS_INTEGER,
+      &&label_OP_FLOOR,
+      &&label_OP_CEIL,
+      &&label_OP_NOP,
+  };
+  static_assert(sizeof(dispatchTable) / sizeof(dispatchTable[0]) ==
+                    OP_NOP + 1,
+                "dispatchTable must cover every opcode");
+
+  // each handler jumps straight to the next one
+#define DISPATCH() goto* dispatchTable[READ_BYTE()]
+#define CASE(op) case op: label_##op
+#else
+#define DISPATCH() break
+#define CASE(op) case op
+#endif
+
+  LOAD_FRAME();
+  try {
+    while (true) {
+      switch (READ_BYTE()) {
+        CASE(OP_CONSTANT): {
+          memory.push(READ_CONSTANT());
+          DISPATCH();
+        }
+        CASE(OP_NULL): {
+          memory.push(NULL_VAL);
+          DISPATCH();
+        }
+        CASE(OP_TRUE): {
+          memory.push(BOOL_VAL(true));
+          DISPATCH();
+        }
+        CASE(OP_FALSE): {
+          memory.push(BOOL_VAL(false));
+          DISPATCH();
+        }
+        CASE(OP_POP): {
           memory.pop();
-          memory.push(*value);
-          break;
+          DISPATCH();
         }
-        bindMethod(instance.getInstanceOf(), name);
-        break;
-      }
-      case OP_SET_PROPERTY: {
-        Value value = memory.top();
-        memory.pop();
+        CASE(OP_GET_LOCAL): {
+          memory.push(slots[READ_BYTE()]);
+          DISPATCH();
+        }
+        CASE(OP_SET_LOCAL): {
+          slots[READ_BYTE()] = memory.top();
+          DISPATCH();
+        }
+        CASE(OP_GET_GLOBAL): {
+          uint16_t index = READ_SHORT();
+          Value value = globals[index];
+          if (IS_UNDEFINED(value)) {
+            runtimeError("Undefined variable '%s'.",
+                         globalTable.getName(index)->getString().c_str());
+          }
+          memory.push(value);
+          DISPATCH();
+        }
+        CASE(OP_SET_GLOBAL): {
+          globals[READ_SHORT()] = memory.top();
+          DISPATCH();
+        }
+        CASE(OP_GET_PROPERTY): {
+          if (!IS_INSTANCE(memory.top())) {
+            runtimeError("Only instances have properties.");
+          }
+
+          ObjectInstance& instance = *(AS_INSTANCE(memory.top()));
+          ObjectString* name = AS_OBJECTSTRING(READ_CONSTANT());
+          ObjectString* className = AS_OBJECTSTRING(READ_CONSTANT());
+          InlineCache& cache = caches[READ_SHORT()];
+
+          // a cache hit has already passed the access check
+          const ObjectClass& instanceOf = instance.getInstanceOf();
+          const CacheEntry* entry =
+              cache.find(&instanceOf, instanceOf.getVersion());
+          if (entry != nullptr) {
+            if (entry->method != nullptr) {
+              memory.top() = OBJECT_VAL(heap.allocate<ObjectBoundMethod>(
+                  memory.top(), entry->method));
+              DISPATCH();
+            }
+            const Value* value = instance.getFieldAt(entry->slot);
+            if (value != nullptr) {
+              memory.top() = *value;
+              DISPATCH();
+            }
+          }
 
-        if (!IS_INSTANCE(memory.top())) {
-          runtimeError("Only instances have fields.");
+          validateAccessModifier(name, className, instance);
+          cacheProperty(cache, instanceOf, name);
+          const Value* value = instance.getField(name);
+          if (value != nullptr) {
+            memory.pop();
+            memory.push(*value);
+            DISPATCH();
+          }
+          bindMethod(instance.getInstanceOf(), name);
+          DISPATCH();
         }
+        CASE(OP_SET_PROPERTY): {
+          Value value = memory.top();
+          memory.pop();
 
-        ObjectInstance* instance = AS_INSTANCE(memory.top()).get();
-        memory.pop();
+          if (!IS_INSTANCE(memory.top())) {
+            runtimeError("Only instances have fields.");
+          }
 
-        std::shared_ptr<ObjectString> name = AS_OBJECTSTRING(readConstant());
-        validateAccessModifier(name, *instance);
+          ObjectInstance* instance = AS_INSTANCE(memory.top());
+          memory.pop();
 
-        instance->setField(name, value);
-        memory.push(value);
-        break;
-      }
-      case OP_GET_SUPER: {
-        std::shared_ptr<ObjectString> name = AS_OBJECTSTRING(readConstant());
-        std::shared_ptr<ObjectClass> superclass = AS_CLASS(memory.top());
-        memory.pop();
-        validateAccessModifier(name, *superclass);
-        bindMethod(*superclass, name);
-        break;
-      }
-      case OP_EQUAL: {
-        Value a = memory.top();
-        memory.pop();
-        Value b = memory.top();
-        memory.pop();
-        memory.push(BOOL_VAL(a == b));
-        break;
-      }
-      case OP_GREATER: {
-        binaryOperation('>');
-        break;
-      }
-      case OP_LESS: {
-        binaryOperation('<');
-        break;
-      }
-      case OP_ADD: {
-        binaryOperation('+');
-        break;
-      }
-      case OP_SUBSTRACT: {
-        binaryOperation('-');
-        break;
-      }
-      case OP_MULTIPLY: {
-        binaryOperation('*');
-        break;
-      }
-      case OP_DIVIDE: {
-        binaryOperation('/');
-        break;
-      }
-      case OP_MODULO: {
-        binaryOperation('%');
-        break;
-      }
-      case OP_NOT: {
-        Value a = memory.top();
-        memory.pop();
-        memory.push(BOOL_VAL(isFalsey(a)));
-        break;
-      }
-      case OP_NEGATE: {
-        if (!IS_NUM(memory.top())) {
-          runtimeError("Operand must be a number.");
-        }
-        double a = AS_NUM(memory.top());
-        memory.pop();
-        memory.push(NUM_VAL(-a));
-        break;
-      }
-      case OP_PRINT: {
-        Value a = memory.top();
-        memory.pop();
-        a.printValue();
-        std::cout << std::endl;
-        break;
-      }
-      case OP_JUMP: {
-        frame->PC += readShort();
-        break;
-      }
-      case OP_JUMP_IF_FALSE: {
-        uint16_t offset = readShort();
-        if (isFalsey(memory.top())) frame->PC += offset;
-        break;
-      }
-      case OP_LOOP: {
-        frame->PC -= readShort();
-        break;
-      }
-      case OP_CALL: {
-        const int argCount = readByte();
-        const size_t argStart = memory.size() - 1 - argCount;
-        callValue(memory.getValueAt(argStart), argCount);
-        frame = &(frames.top());
-        break;
-      }
-      case OP_INVOKE: {
-        std::shared_ptr<ObjectString> method = AS_OBJECTSTRING(readConstant());
-        int argCount = readByte();
-        invoke(method, argCount);
-        frame = &(frames.top());
-        break;
-      }
-      case OP_SUPER_INVOKE: {
-        std::shared_ptr<ObjectString> method = AS_OBJECTSTRING(readConstant());
-        int argCount = readByte();
-        std::shared_ptr<ObjectClass> superclass = AS_CLASS(memory.top());
-        memory.pop();
-        validateAccessModifier(method, *superclass);
-        invokeFromClass(*superclass, method, argCount);
-        frame = &(frames.top());
-        break;
-      }
-      case OP_CLOSURE: {
-        std::shared_ptr<ObjectFunction> function = AS_FUNCTION(readConstant());
-        std::shared_ptr<ObjectClosure> closure =
-            std::make_shared<ObjectClosure>(function);
-        memory.push(OBJECT_VAL(closure));
-        for (int i = 0; i < closure->getUpvalueCount(); i++) {
-          uint8_t isLocal = readByte();
-          uint8_t index = readByte();
-          if (isLocal) {
-            closure->addUpvalue(
-                captureUpvalue(memory.getValuePtrAt(frame->stackPos + index),
-                               frame->stackPos + index));
+          ObjectString* name = AS_OBJECTSTRING(READ_CONSTANT());
+          ObjectString* className = AS_OBJECTSTRING(READ_CONSTANT());
+          InlineCache& cache = caches[READ_SHORT()];
+
+          const ObjectClass& instanceOf = instance->getInstanceOf();
+          const CacheEntry* entry =
+              cache.find(&instanceOf, instanceOf.getVersion());
+          Value* field = entry != nullptr && entry->method == nullptr
+                             ? instance->getFieldAt(entry->slot)
+                             : nullptr;
+          if (field != nullptr) {
+            *field = value;
           } else {
-            closure->addUpvalue(frame->closure.getUpvalue(index));
+            validateAccessModifier(name, className, *instance);
+            instance->setField(name, value);
+            cacheProperty(cache, instanceOf, name);
           }
+          memory.push(value);
+          DISPATCH();
         }
-        break;
-      }
-      case OP_INHERIT: {
-        Value parent = memory.getValueAt(memory.size() - 2);
-        if (!IS_CLASS(parent)) {
-          runtimeError("Must inherit from a class.");
-        }
-        std::shared_ptr<ObjectClass> child = AS_CLASS(memory.top());
-        child->copyMethodsFrom(*(AS_CLASS(parent)));
-        child->copyFieldsFrom(*(AS_CLASS(parent)));
-        memory.pop();  // Pop the child class
-        break;
-      }
-      case OP_GET_UPVALUE: {
-        uint8_t slot = readByte();
-        memory.push(*(frame->closure.getUpvalue(slot)->getLocation()));
-        break;
-      }
-      case OP_SET_UPVALUE: {
-        uint8_t slot = readByte();
-        *(frame->closure.getUpvalue(slot)->getLocation()) = memory.top();
-        break;
-      }
-      case OP_CLOSE_UPVALUE: {
-        closeUpvalues(memory.size() - 1);
-        memory.pop();
-        break;
-      }
-      case OP_FIELD: {
-        defineField(AS_OBJECTSTRING(readConstant()));
-        break;
-      }
-      case OP_METHOD: {
-        defineMethod(AS_OBJECTSTRING(readConstant()));
-        break;
-      }
-      case OP_RETURN: {
-        // retrieve and pop return value
-        Value top = memory.top();
-        memory.pop();
-        closeUpvalues(frame->stackPos);
-
-        // pop all local variables alongside function object
-        if (frames.size() > 1) {
-          size_t initialMemorySize = memory.size();
-          for (size_t i = frames.top().stackPos; i < initialMemorySize; i++) {
-            memory.pop();
+        CASE(OP_GET_SUPER): {
+          ObjectString* name = AS_OBJECTSTRING(READ_CONSTANT());
+          ip++;  // the accessing class is irrelevant for super
+          ObjectClass* superclass = AS_CLASS(memory.top());
+          memory.pop();
+          validateAccessModifier(name, *superclass);
+          bindMethod(*superclass, name);
+          DISPATCH();
+        }
+        CASE(OP_EQUAL): {
+          Value a = memory.top();
+          memory.pop();
+          Value b = memory.top();
+          memory.pop();
+          memory.push(BOOL_VAL(a == b));
+          DISPATCH();
+        }
+        CASE(OP_GREATER): {
+          QUICKEN_BINARY(OP_GREATER_NUM, BOOL_VAL(left > right), '>');
+          DISPATCH();
+        }
+        CASE(OP_GREATER_NUM): {
+          GUARD_BINARY(OP_GREATER, BOOL_VAL(left > right), '>');
+          DISPATCH();
+        }
+        CASE(OP_LESS): {
+          QUICKEN_BINARY(OP_LESS_NUM, BOOL_VAL(left < right), '<');
+          DISPATCH();
+        }
+        CASE(OP_LESS_NUM): {
+          GUARD_BINARY(OP_LESS, BOOL_VAL(left < right), '<');
+          DISPATCH();
+        }
+        CASE(OP_ADD): {
+          QUICKEN_BINARY(OP_ADD_NUM, NUM_VAL(left + right), '+');
+          DISPATCH();
+        }
+        CASE(OP_ADD_NUM): {
+          GUARD_BINARY(OP_ADD, NUM_VAL(left + right), '+');
+          DISPATCH();
+        }
+        CASE(OP_SUBSTRACT): {
+          QUICKEN_BINARY(OP_SUBSTRACT_NUM, NUM_VAL(left - right), '-');
+          DISPATCH();
+        }
+        CASE(OP_SUBSTRACT_NUM): {
+          GUARD_BINARY(OP_SUBSTRACT, NUM_VAL(left - right), '-');
+          DISPATCH();
+        }
+        CASE(OP_MULTIPLY): {
+          QUICKEN_BINARY(OP_MULTIPLY_NUM, NUM_VAL(left * right), '*');
+          DISPATCH();
+        }
+        CASE(OP_MULTIPLY_NUM): {
+          GUARD_BINARY(OP_MULTIPLY, NUM_VAL(left * right), '*');
+          DISPATCH();
+        }
+        CASE(OP_DIVIDE): {
+          QUICKEN_BINARY(OP_DIVIDE_NUM, NUM_VAL(left / right), '/');
+          DISPATCH();
+        }
+        CASE(OP_DIVIDE_NUM): {
+          GUARD_BINARY(OP_DIVIDE, NUM_VAL(left / right), '/');
+          DISPATCH();
+        }
+        CASE(OP_MODULO): {
+          QUICKEN_BINARY(OP_MODULO_NUM, NUM_VAL(fmod(left, right)), '%');
+          DISPATCH();
+        }
+        CASE(OP_MODULO_NUM): {
+          GUARD_BINARY(OP_MODULO, NUM_VAL(fmod(left, right)), '%');
+          DISPATCH();
+        }
+        CASE(OP_SIZE): {
+          INTRINSIC(sizeIntrinsic, NUM_VAL(lengthOf(arg)));
+          DISPATCH();
+        }
+        CASE(OP_TYPEOF): {
+          INTRINSIC(typeIntrinsic, OBJECT_VAL(typeOf(arg)));
+          DISPATCH();
+        }
+        CASE(OP_IS_INTEGER): {
+          INTRINSIC(isIntegerIntrinsic, BOOL_VAL(isInteger(arg)));
+          DISPATCH();
+        }
+        CASE(OP_FLOOR): {
+          INTRINSIC(floorIntrinsic,
+                    NUM_VAL(std::floor(numberArgument("floor", arg))));
+          DISPATCH();
+        }
+        CASE(OP_CEIL): {
+          INTRINSIC(ceilIntrinsic,
+                    NUM_VAL(std::ceil(numberArgument("ceil", arg))));
+          DISPATCH();
+        }
+        CASE(OP_NOT): {
+          Value a = memory.top();
+          memory.pop();
+          memory.push(BOOL_VAL(isFalsey(a)));
+          DISPATCH();
+        }
+        CASE(OP_NEGATE): {
+          if (!IS_NUM(memory.top())) {
+            runtimeError("Operand must be a number.");
           }
-        } else {  // if we are at <script>, only pop once, since there shouldn't
-                  // be any local variables
+          double a = AS_NUM(memory.top());
           memory.pop();
+          memory.push(NUM_VAL(-a));
+          DISPATCH();
         }
-
-        // pop function frame
-        frames.pop();
-
-        if (frames.empty()) {
-#ifdef DEBUG
-          if (memory.size() != 0) {
-            std::cout << "PANIC: STACK IS NOT EMPTY!" << std::endl << std::endl;
+        CASE(OP_PRINT): {
+          Value a = memory.top();
+          memory.pop();
+          a.printValue();
+          std::cout << '\n';
+          if (lineBuffered) std::cout.flush();
+          DISPATCH();
+        }
+        CASE(OP_JUMP): {
+          uint16_t offset = READ_SHORT();
+          ip += offset;
+          DISPATCH();
+        }
+        CASE(OP_JUMP_IF_FALSE): {
+          uint16_t offset = READ_SHORT();
+          if (isFalsey(memory.top())) ip += offset;
+          DISPATCH();
+        }
+        CASE(OP_LOOP): {
+          uint16_t offset = READ_SHORT();
+          ip -= offset;
+          if (heap.shouldCollect()) heap.collectGarbage();
+          DISPATCH();
+        }
+        CASE(OP_CALL): {
+          if (heap.shouldCollect()) heap.collectGarbage();
+          const int argCount = READ_BYTE();
+          const size_t argStart = memory.size() - 1 - argCount;
+          frame->ip = ip;
+          callValue(memory.getValueAt(argStart), argCount);
+          LOAD_FRAME();
+          DISPATCH();
+        }
+        CASE(OP_INVOKE): {
+          if (heap.shouldCollect()) heap.collectGarbage();
+          ObjectString* method = AS_OBJECTSTRING(READ_CONSTANT());
+          int argCount = READ_BYTE();
+          ObjectString* className = AS_OBJECTSTRING(READ_CONSTANT());
+          InlineCache& cache = caches[READ_SHORT()];
+          frame->ip = ip;
+          invoke(method, className, argCount, cache);
+          LOAD_FRAME();
+          DISPATCH();
+        }
+        CASE(OP_SUPER_INVOKE): {
+          if (heap.shouldCollect()) heap.collectGarbage();
+          ObjectString* method = AS_OBJECTSTRING(READ_CONSTANT());
+          int argCount = READ_BYTE();
+          ip++;  // the accessing class is irrelevant for super
+          ObjectClass* superclass = AS_CLASS(memory.top());
+          memory.pop();
+          validateAccessModifier(method, *superclass);
+          frame->ip = ip;
+          invokeFromClass(*superclass, method, argCount);
+          LOAD_FRAME();
+          DISPATCH();
+        }
+        CASE(OP_CLOSURE): {
+          ObjectFunction* function = AS_FUNCTION(READ_CONSTANT());
+          ObjectClosure* closure = heap.allocate<ObjectClosure>(function);
+          memory.push(OBJECT_VAL(closure));
+          for (int i = 0; i < closure->getUpvalueCount(); i++) {
+            uint8_t isLocal = READ_BYTE();
+            uint8_t index = READ_BYTE();
+            if (isLocal) {
+              closure->addUpvalue(
+                  captureUpvalue(slots + index, frame->stackPos + index));
+            } else {
+              closure->addUpvalue(frame->closure->getUpvalue(index));
+            }
           }
-          printStack(memory);
-#endif
-          if (memory.size() != 0) {
-            runtimeError("Stack is not empty.");
+          DISPATCH();
+        }
+        CASE(OP_INHERIT): {
+          Value parent = memory.getValueAt(memory.size() - 2);
+          if (!IS_CLASS(parent)) {
+            runtimeError("Must inherit from a class.");
           }
-          return;
+          ObjectClass* child = AS_CLASS(memory.top());
+          child->copyMethodsFrom(*(AS_CLASS(parent)));
+          child->copyFieldsFrom(*(AS_CLASS(parent)));
+          memory.pop();  // Pop the child class
+          DISPATCH();
         }
-
-        // push return value on stack (for outer scope) and set next frame
-        memory.push(top);
-        frame = &(frames.top());
-        break;
-      }
-      case OP_CLASS: {
-        memory.push(OBJECT_VAL(
-            std::make_shared<ObjectClass>(AS_STRING(readConstant()))));
-        break;
-      }
-      case OP_ARRAY: {
-        uint8_t itemNum = readByte();
-        std::shared_ptr<ObjectList> arr = std::make_shared<ObjectList>();
-        for (unsigned i = memory.size() - itemNum; i < memory.size(); i++) {
-          arr->add(memory.getValueAt(i));
+        CASE(OP_GET_UPVALUE): {
+          uint8_t slot = READ_BYTE();
+          memory.push(*(frame->closure->getUpvalue(slot)->getLocation()));
+          DISPATCH();
         }
-        for (unsigned i = 0; i < itemNum; i++) {
+        CASE(OP_SET_UPVALUE): {
+          uint8_t slot = READ_BYTE();
+          *(frame->closure->getUpvalue(slot)->getLocation()) = memory.top();
+          DISPATCH();
+        }
+        CASE(OP_CLOSE_UPVALUE): {
+          closeUpvalues(memory.size() - 1);
           memory.pop();
+          DISPATCH();
         }
-        memory.push(OBJECT_VAL(arr));
-        break;
-      }
-      case OP_ARRAY_GET: {
-        Value& index = memory.top();
-        if (!IS_NUM(index)) {
-          runtimeError("Index must be a positive integer.");
+        CASE(OP_FIELD): {
+          ObjectString* name = AS_OBJECTSTRING(READ_CONSTANT());
+          defineField(name, (AccessModifier)READ_BYTE());
+          DISPATCH();
         }
-        double indexVal = AS_NUM(index);
-        if (indexVal < 0) {
-          runtimeError("Index must be a positive integer.");
+        CASE(OP_METHOD): {
+          ObjectString* name = AS_OBJECTSTRING(READ_CONSTANT());
+          defineMethod(name, (AccessModifier)READ_BYTE());
+          DISPATCH();
         }
-        if (ceil(indexVal) != floor(indexVal)) {
-          runtimeError("Index must be a positive integer.");
+        CASE(OP_RETURN): {
+          // retrieve and pop return value
+          Value top = memory.top();
+          memory.pop();
+          closeUpvalues(frame->stackPos);
+
+          // pop all local variables alongside function object
+          if (frames.size() > 1) {
+            memory.truncate(frame->stackPos);
+          } else {  // if we are at <script>, only pop once, since there
+                    // shouldn't be any local variables
+            memory.pop();
+          }
+
+          // pop function frame
+          frames.pop_back();
+
+          if (frames.empty()) {
+#ifdef DEBUG
+            if (memory.size() != 0) {
+              std::cout << "PANIC: STACK IS NOT EMPTY!" << std::endl
+                        << std::endl;
+            }
+            printStack(memory);
+#endif
+            if (memory.size() != 0) {
+              runtimeError("Stack is not empty.");
+            }
+            return;
+          }
+
+          // push return value on stack (for outer scope) and set next frame
+          memory.push(top);
+          LOAD_FRAME();
+          DISPATCH();
         }
-        memory.pop();
-        std::shared_ptr<ObjectList> arr = AS_OBJECTLIST(memory.top());
-        if (indexVal >= arr->size()) {
-          runtimeError("Index out of bounds.");
+        CASE(OP_CLASS): {
+          memory.push(OBJECT_VAL(
+              heap.allocate<ObjectClass>(AS_OBJECTSTRING(READ_CONSTANT()))));
+          DISPATCH();
         }
-        memory.pop();
-        memory.push(arr->get(indexVal));
-        break;
-      }
-      case OP_ARRAY_SET: {
-        Value value = memory.top();
-        memory.pop();
-        Value& index = memory.top();
-        if (!IS_NUM(index)) {
-          runtimeError("Index must be a postive integer.");
-        }
-        double indexVal = AS_NUM(index);
-        if (indexVal < 0) {
-          runtimeError("Index must be a positive integer.");
+        CASE(OP_ARRAY): {
+          uint8_t itemNum = READ_BYTE();
+          Value* items = memory.getValuePtrAt(memory.size() - itemNum);
+          ObjectList* arr = heap.allocate<ObjectList>(
+              std::vector<Value>(items, items + itemNum));
+          memory.popN(itemNum);
+          memory.push(OBJECT_VAL(arr));
+          DISPATCH();
         }
-        if (ceil(indexVal) != floor(indexVal)) {
-          runtimeError("Index must be a positive integer.");
+        CASE(OP_ARRAY_GET): {
+          if (IS_MAP(memory.peek(1))) {
+            ObjectMap* map = AS_OBJECTMAP(memory.peek(1));
+            const Value* value = map->get(memory.top());
+            memory.pop();
+            // missing keys read as null
+            memory.top() = value == nullptr ? NULL_VAL : *value;
+            DISPATCH();
+          }
+          if (IS_DEQUE(memory.peek(1))) {
+            ObjectDeque* deque = AS_DEQUE(memory.peek(1));
+            Value value = deque->get(listIndex(memory.top(), deque->size()));
+            memory.pop();
+            memory.top() = value;
+            DISPATCH();
+          }
+          Value& index = memory.top();
+          if (!IS_NUM(index)) {
+            runtimeError("Index must be a positive integer.");
+          }
+          double indexVal = AS_NUM(index);
+          if (indexVal < 0) {
+            runtimeError("Index must be a positive integer.");
+          }
+          if (ceil(indexVal) != floor(indexVal)) {
+            runtimeError("Index must be a positive integer.");
+          }
+          memory.pop();
+          ObjectList* arr = AS_OBJECTLIST(memory.top());
+          if (indexVal >= arr->size()) {
+            runtimeError("Index out of bounds.");
+          }
+          memory.pop();
+          memory.push(arr->get(indexVal));
+          DISPATCH();
         }
-        memory.pop();
-        std::shared_ptr<ObjectList> arr = AS_OBJECTLIST(memory.top());
-        if (indexVal >= arr->size()) {
-          runtimeError("Index out of bounds.");
+        CASE(OP_ARRAY_SET): {
+          Value value = memory.top();
+          memory.pop();
+          if (IS_MAP(memory.peek(1))) {
+            AS_OBJECTMAP(memory.peek(1))->set(memory.top(), value);
+            memory.pop();
+            memory.top() = value;
+            DISPATCH();
+          }
+          if (IS_DEQUE(memory.peek(1))) {
+            ObjectDeque* deque = AS_DEQUE(memory.peek(1));
+            deque->set(value, listIndex(memory.top(), deque->size()));
+            memory.pop();
+            memory.top() = value;
+            DISPATCH();
+          }
+          Value& index = memory.top();
+          if (!IS_NUM(index)) {
+            runtimeError("Index must be a postive integer.");
+          }
+          double indexVal = AS_NUM(index);
+          if (indexVal < 0) {
+            runtimeError("Index must be a positive integer.");
+          }
+          if (ceil(indexVal) != floor(indexVal)) {
+            runtimeError("Index must be a positive integer.");
+          }
+          memory.pop();
+          ObjectList* arr = AS_OBJECTLIST(memory.top());
+          if (indexVal >= arr->size()) {
+            runtimeError("Index out of bounds.");
+          }
+          arr->set(value, indexVal);
+          DISPATCH();
         }
-        arr->set(value, indexVal);
-        break;
-      }
-      case OP_DUPLICATE: {
-        uint8_t repeat = readByte();
-        size_t initialMemorySize = memory.size();
-        for (unsigned i = memory.size() - repeat; i < initialMemorySize; ++i) {
-          memory.push(memory.getValueAt(i));
+        CASE(OP_MAP): {
+          uint8_t pairNum = READ_BYTE();
+          Value* items = memory.getValuePtrAt(memory.size() - 2 * pairNum);
+          ObjectMap* map = heap.allocate<ObjectMap>();
+          for (uint8_t i = 0; i < pairNum; i++) {
+            map->set(items[2 * i], items[2 * i + 1]);
+          }
+          memory.popN(2 * pairNum);
+          memory.push(OBJECT_VAL(map));
+          DISPATCH();
+        }
+        CASE(OP_DUPLICATE): {
+          memory.duplicate(READ_BYTE());
+          DISPATCH();
+        }
+        CASE(OP_NOP): {
+          DISPATCH();
         }
-        break;
-      }
-      case OP_NOP: {
-        break;
       }
     }
+  } catch (const VMException& e) {
+    if (!frames.empty()) frames.back().ip = ip;
+    unwindStack();
+    throw;
   }
+
+#undef LOAD_FRAME
+#undef READ_BYTE
+#undef READ_SHORT
+#undef READ_CONSTANT
+#undef DISPATCH
+#undef CASE
+#undef NUM_OPERANDS
+#undef BINARY_NUM
+#undef QUICKEN_BINARY
+#undef GUARD_BINARY
+#undef INTRINSIC
 }
 
-void VM::validateAccessModifier(std::shared_ptr<ObjectString> name,
-                                ObjectClass& superclass) {
-  std::shared_ptr<ObjectString> className = AS_OBJECTSTRING(readConstant());
+void VM::validateAccessModifier(ObjectString* name, ObjectClass& superclass) {
   const AccessModifier* am = superclass.getAccessModifier(name);
   if (am == nullptr) {
     runtimeError("Method %s is not declared in class %s.",
@@ -595,9 +970,8 @@ void VM::validateAccessModifier(std::shared_ptr<ObjectString> name,
   }
 }
 
-void VM::validateAccessModifier(std::shared_ptr<ObjectString> name,
+void VM::validateAccessModifier(ObjectString* name, ObjectString* className,
                                 ObjectInstance& instance) {
-  std::shared_ptr<ObjectString> className = AS_OBJECTSTRING(readConstant());
   const AccessModifier* am = instance.getInstanceOf().getAccessModifier(name);
   std::string typeStr =
       instance.getInstanceOf().getMethod(name) != nullptr ? "Method" : "Field";
@@ -623,33 +997,37 @@ void VM::validateAccessModifier(std::shared_ptr<ObjectString> name,
   }
 }
 
-void VM::call(std::shared_ptr<ObjectClosure> closure, int argCount) {
+void VM::call(ObjectClosure* closure, int argCount) {
   if (argCount != closure->getFunction()->getArity()) {
     runtimeError("Expected %d arguments but found %d.",
                  closure->getFunction()->getArity(), argCount);
   }
 
-  if (frames.size() == FRAMES_MAX) {
+  // the frame starts at the callee and must fit everything its code can
+  // push, since pushes aren't checked
+  size_t stackPos = memory.size() - argCount - 1;
+  if (frames.size() == FRAMES_MAX ||
+      stackPos + closure->getFunction()->getMaxStack() > STACK_MAX) {
     runtimeError("Stack overflow.");
   }
 
-  CallFrame newFrame{*closure, memory.size() - argCount - 1, 0};
-  frames.push(newFrame);
+  frames.push_back(CallFrame{
+      closure, closure->getFunction()->getChunk().getCode(), stackPos});
 }
 
 void VM::callValue(Value callee, int argCount) {
   if (IS_OBJECT(callee)) {
     switch (OBJECT_TYPE(callee)) {
       case OBJECT_BOUND_METHOD: {
-        ObjectBoundMethod* bound = AS_BOUND_METHOD(callee).get();
+        ObjectBoundMethod* bound = AS_BOUND_METHOD(callee);
         memory.setValueAt(bound->getReceiver(), memory.size() - 1 - argCount);
         call(bound->getMethod(), argCount);
         return;
       }
       case OBJECT_CLASS: {
-        ObjectClass* instanceOf = AS_CLASS(callee).get();
+        ObjectClass* instanceOf = AS_CLASS(callee);
         memory.setValueAt(
-            OBJECT_VAL(std::make_shared<ObjectInstance>(*instanceOf)),
+            OBJECT_VAL(heap.allocate<ObjectInstance>(*instanceOf)),
             memory.size() - 1 - argCount);
         const Value* initializer = instanceOf->getMethod(constructorString);
         if (initializer != nullptr) {
@@ -663,11 +1041,17 @@ void VM::callValue(Value callee, int argCount) {
         call(AS_CLOSURE(callee), argCount);
         return;
       case OBJECT_NATIVE: {
-        NativeFn native = AS_NATIVE(callee)->getFunction();
-        Value result = native(argCount, memory.size() - argCount);
-        for (int i = 0; i <= argCount; i++) {
-          memory.pop();
+        ObjectNative* native = AS_NATIVE(callee);
+        if (argCount < native->getMinArity() ||
+            argCount > native->getMaxArity()) {
+          nativeArityError(native, argCount);
         }
+        // the arguments stay on the stack while the native runs, then the
+        // callee and the arguments are dropped at once
+        size_t start = memory.size() - argCount;
+        Value result = native->getFunction()(
+            *this, std::span<Value>(memory.getValuePtrAt(start), argCount));
+        memory.truncate(start - 1);
         memory.push(result);
         return;
       }
@@ -684,180 +1068,430 @@ bool VM::isFalsey(Value value) const {
          (IS_NUM(value) && !AS_NUM(value));
 }
 
-void VM::concatenate(const std::string& c, const std::string& d) {
-  memory.push(OBJECT_VAL(std::make_shared<ObjectString>(d + c)));
+size_t VM::listIndex(Value index, size_t size) {
+  if (!IS_NUM(index) || AS_NUM(index) < 0 ||
+      std::floor(AS_NUM(index)) != std::ceil(AS_NUM(index))) {
+    runtimeError("Index must be a positive integer.");
+  }
+  if (AS_NUM(index) >= size) {
+    runtimeError("Index out of bounds.");
+  }
+  return (size_t)AS_NUM(index);
 }
 
-void VM::concatenate(const std::string& c, double d) {
-  std::stringstream num;
-  num << d;
-  std::string numStr;
-  num >> numStr;
-  memory.push(OBJECT_VAL(std::make_shared<ObjectString>(c + numStr)));
+void VM::concatenate(ObjectString* left, ObjectString* right) {
+  if (right->getLength() == 0) {
+    memory.push(OBJECT_VAL(left));
+  } else if (left->getLength() == 0) {
+    memory.push(OBJECT_VAL(right));
+  } else if (left->getLength() + right->getLength() < ROPE_MIN_LENGTH) {
+    memory.push(
+        OBJECT_VAL(heap.intern(left->getString() + right->getString())));
+  } else {
+    // long strings are only copied once they're flattened, so that building
+    // a string piece by piece stays linear
+    memory.push(OBJECT_VAL(heap.allocate<ObjectString>(left, right)));
+  }
 }
 
-Chunk& VM::getTopChunk() {
-  return frames.top().closure.getFunction()->getChunk();
+void VM::concatenate(ObjectString* left, double right) {
+  char text[NUMBER_TEXT_MAX];
+  size_t length = formatNumber(right, text);
+  if (left->getLength() + length < ROPE_MIN_LENGTH) {
+    std::string str;
+    str.reserve(left->getLength() + length);
+    str.append(left->getString()).append(text, length);
+    memory.push(OBJECT_VAL(heap.intern(str)));
+  } else {
+    concatenate(left, heap.intern(std::string(text, length)));
+  }
 }
 
-uint8_t VM::readByte() {
-  uint8_t byte = getTopChunk().getBytecodeAt(frames.top().PC).code;
-  frames.top().PC++;
-  return byte;
+void VM::defineNative(const std::string& name, NativeFn function, int arity) {
+  defineNative(name, function, arity, arity);
 }
 
-Value VM::readConstant() { return getTopChunk().getConstantAt(readByte()); }
+void VM::defineNative(const std::string& name, NativeFn function,
+                      int minArity, int maxArity) {
+  size_t index = globalTable.indexOf(name);
+  if (index >= globals.size()) globals.resize(index + 1, UNDEFINED_VAL);
+  globals[index] = OBJECT_VAL(heap.allocate<ObjectNative>(
+      function, minArity, maxArity, globalTable.getName(index)));
+}
 
-uint16_t VM::readShort() {
-  uint8_t high = readByte();
-  uint8_t lo = readByte();
-  return (uint16_t)((high << 8) | lo);
+VM::Intrinsic VM::makeIntrinsic(const std::string& name) {
+  size_t slot = globalTable.indexOf(name);
+  return Intrinsic{slot, AS_OBJECT(globals[slot])};
 }
 
-void VM::defineNative(std::string name, NativeFn function) {
-  std::shared_ptr<ObjectString> nativeName =
-      std::make_shared<ObjectString>(name);
-  globals.emplace(nativeName, OBJECT_VAL(std::make_shared<ObjectNative>(
-                                  function, nativeName)));
+void VM::callIntrinsicGlobal(const Intrinsic& intrinsic, int argCount) {
+  if (heap.shouldCollect()) heap.collectGarbage();
+  Value callee = globals[intrinsic.slot];
+  if (IS_UNDEFINED(callee)) {
+    runtimeError("Undefined variable '%s'.",
+                 globalTable.getName(intrinsic.slot)->getString().c_str());
+  }
+
+  // the callee goes below its arguments, as if OP_CALL had been emitted
+  size_t argStart = memory.size() - argCount;
+  memory.push(callee);
+  for (size_t i = memory.size() - 1; i > argStart; i--) {
+    memory.setValueAt(memory.getValueAt(i - 1), i);
+  }
+  memory.setValueAt(callee, argStart);
+  callValue(callee, argCount);
 }
 
-Value VM::throwNative(int argCount, size_t start) {
-  if (argCount != 1) {
-    runtimeError("Expect 1 argument for 'throw', but found %d.", argCount);
+void VM::nativeArityError(ObjectNative* native, int argCount) {
+  const char* name = native->getName()->getString().c_str();
+  int minArity = native->getMinArity();
+  int maxArity = native->getMaxArity();
+  if (minArity == maxArity) {
+    runtimeError("Expect %d argument%s for '%s', but found %d.", minArity,
+                 minArity == 1 ? "" : "s", name, argCount);
+  } else if (maxArity == ObjectNative::VARIADIC) {
+    runtimeError("Expect at least %d argument%s for '%s', but found %d.",
+                 minArity, minArity == 1 ? "" : "s", name, argCount);
   }
-  Value error = memory.getValueAt(start);
+  runtimeError("Expect %d to %d arguments for '%s', but found %d.", minArity,
+               maxArity, name, argCount);
+}
+
+Value VM::throwNative(VM& vm, std::span<Value> args) {
+  Value error = args[0];
   if (IS_NUM(error) && std::ceil(AS_NUM(error)) == std::floor(AS_NUM(error)) &&
       AS_NUM(error) >= 0) {
     std::string errorMessage = "Program exited with exit code " +
                                std::to_string((unsigned)AS_NUM(error));
-    runtimeError(errorMessage.c_str());
+    vm.runtimeError(errorMessage.c_str());
   } else if (IS_STRING(error)) {
     std::string errorMessage = AS_STRING(error);
-    runtimeError(errorMessage.c_str());
+    vm.runtimeError(errorMessage.c_str());
   }
-  runtimeError(
+  vm.runtimeError(
       "Argument must be a error message string or a non-negative integer exit "
       "code.");
   return NULL_VAL;
 }
 
-Value VM::typeNative(int argCount, size_t start) {
-  if (argCount != 1) {
-    runtimeError("Expect 1 argument for 'type', but found %d.", argCount);
+const ObjectString* VM::typeOf(Value value) {
+  if (IS_NUM(value)) {
+    return typeNames.number;
+  } else if (IS_BOOL(value)) {
+    return typeNames.boolean;
+  } else if (IS_NULL(value)) {
+    return typeNames.null;
+  } else if (IS_CLASS(value)) {
+    return typeNames.objClass;
+  } else if (IS_BOUND_METHOD(value) || IS_FUNCTION(value) ||
+             IS_NATIVE(value) || IS_CLOSURE(value)) {
+    return typeNames.function;
+  } else if (IS_LIST(value)) {
+    return typeNames.list;
+  } else if (IS_MAP(value)) {
+    return typeNames.map;
+  } else if (IS_PRIORITY_QUEUE(value)) {
+    return typeNames.priorityQueue;
+  } else if (IS_DEQUE(value)) {
+    return typeNames.deque;
+  } else if (IS_RANDOM(value)) {
+    return typeNames.random;
+  } else if (IS_STRING_BUILDER(value)) {
+    return typeNames.stringBuilder;
+  } else if (IS_INSTANCE(value)) {
+    return &AS_INSTANCE(value)->getInstanceOf().getName();
+  } else if (IS_STRING(value)) {
+    return typeNames.string;
   }
-  Value val = memory.getValueAt(start);
-  if (IS_NUM(val)) {
-    return OBJECT_VAL(std::make_shared<ObjectString>("number"));
-  } else if (IS_BOOL(val)) {
-    return OBJECT_VAL(std::make_shared<ObjectString>("boolean"));
-  } else if (IS_NULL(val)) {
-    return OBJECT_VAL(std::make_shared<ObjectString>("null"));
-  } else if (IS_CLASS(val)) {
-    return OBJECT_VAL(std::make_shared<ObjectString>("class"));
-  } else if (IS_BOUND_METHOD(val) || IS_FUNCTION(val) || IS_NATIVE(val) ||
-             IS_CLOSURE(val)) {
-    return OBJECT_VAL(std::make_shared<ObjectString>("function"));
-  } else if (IS_LIST(val)) {
-    return OBJECT_VAL(std::make_shared<ObjectString>("list"));
-  } else if (IS_INSTANCE(val)) {
-    return OBJECT_VAL(std::make_shared<ObjectString>(
-        AS_INSTANCE(val)->getInstanceOf().getName().getString()));
-  } else if (IS_STRING(val)) {
-    return OBJECT_VAL(std::make_shared<ObjectString>("string"));
-  }
-  return OBJECT_VAL(
-      std::make_shared<ObjectString>("unknown"));  // unreachable by normal user
+  return typeNames.unknown;  // unreachable by normal user
 }
 
-Value VM::floorNative(int argCount, size_t start) {
-  if (argCount != 1) {
-    runtimeError("Expect 1 argument for 'floor', but found %d.", argCount);
-  }
-  Value num = memory.getValueAt(start);
-  if (!IS_NUM(num)) {
-    runtimeError("Expects a number as argument for 'floor'.");
+Value VM::typeNative(VM& vm, std::span<Value> args) {
+  return OBJECT_VAL(vm.typeOf(args[0]));
+}
+
+double VM::numberArgument(const char* name, Value value) {
+  if (!IS_NUM(value)) {
+    runtimeError("Expects a number as argument for '%s'.", name);
   }
+  return AS_NUM(value);
+}
+
+Value VM::floorNative(VM& vm, std::span<Value> args) {
+  return NUM_VAL(std::floor(vm.numberArgument("floor", args[0])));
+}
 
-  double actualNum = AS_NUM(num);
-  return NUM_VAL(std::floor(actualNum));
+Value VM::ceilNative(VM& vm, std::span<Value> args) {
+  return NUM_VAL(std::ceil(vm.numberArgument("ceil", args[0])));
 }
-Value VM::ceilNative(int argCount, size_t start) {
-  if (argCount != 1) {
-    runtimeError("Expect 1 argument for 'ceil', but found %d.", argCount);
+
+Value VM::isIntegerNative(VM&, std::span<Value> args) {
+  return BOOL_VAL(isInteger(args[0]));
+}
+
+Value VM::clockNative(VM&, std::span<Value>) {
+  return NUM_VAL((double)clock() / CLOCKS_PER_SEC);
+}
+
+Value VM::flushNative(VM&, std::span<Value>) {
+  std::cout.flush();
+  return NULL_VAL;
+}
+
+Value VM::toStringNative(VM&, std::span<Value> args) {
+  Value value = args[0];
+  if (IS_STRING(value)) return value;
+  if (IS_NUM(value)) {
+    char text[NUMBER_TEXT_MAX];
+    return OBJECT_VAL(
+        heap.intern(std::string(text, formatNumber(AS_NUM(value), text))));
   }
-  Value num = memory.getValueAt(start);
-  if (!IS_NUM(num)) {
-    runtimeError("Expects a number as argument for 'ceil'.");
+  if (IS_STRING_BUILDER(value)) {
+    return OBJECT_VAL(builtString(AS_STRING_BUILDER(value)));
   }
 
-  double actualNum = AS_NUM(num);
-  return NUM_VAL(std::ceil(actualNum));
+  // anything else reads the way print shows it
+  return OBJECT_VAL(heap.intern(printedText(value)));
 }
 
-Value VM::clockNative(int argCount, size_t index) {
-  if (argCount != 0) {
-    runtimeError("Expect 0 argument for 'clock', but found %d.", argCount);
-  }
-  (void)index;
-  return NUM_VAL((double)clock() / CLOCKS_PER_SEC);
+std::string VM::printedText(Value value) {
+  std::ostringstream text;
+  std::streambuf* output = std::cout.rdbuf(text.rdbuf());
+  value.printValue();
+  std::cout.rdbuf(output);
+  return text.str();
 }
 
-Value VM::substringNative(int argCount, size_t start) {
-  if (argCount != 3) {
-    runtimeError("Expect 3 arguments for 'substring', but found %d.", argCount);
+Value VM::parseNumberNative(VM& vm, std::span<Value> args) {
+  Value text = args[0];
+  if (!IS_STRING(text)) {
+    vm.runtimeError("Expect a string as argument for 'parseNumber'.");
   }
-  Value string = memory.getValueAt(start);
+  // returns null if the string isn't a number
+  double number;
+  if (!parseNumber(AS_STRING(text), number)) return NULL_VAL;
+  return NUM_VAL(number);
+}
+
+Value VM::substringNative(VM& vm, std::span<Value> args) {
+  Value string = args[0];
   if (!IS_STRING(string)) {
-    runtimeError("Expect a string as first argument for 'substring'.");
+    vm.runtimeError("Expect a string as first argument for 'substring'.");
   }
-  Value startIndex = memory.getValueAt(start + 1);
-  Value endIndex = memory.getValueAt(start + 2);
+  Value startIndex = args[1];
+  Value endIndex = args[2];
   if (!IS_NUM(startIndex) || !IS_NUM(endIndex)) {
-    runtimeError("Indices must be non-negative integers for 'substring'.");
+    vm.runtimeError("Indices must be non-negative integers for 'substring'.");
   }
-  std::string strVal = AS_STRING(string);
+  ObjectString* source = AS_OBJECTSTRING(string);
   double startIndexVal = AS_NUM(startIndex);
   double endIndexVal = AS_NUM(endIndex);
   if (floor(startIndexVal) != ceil(startIndexVal) ||
       floor(endIndexVal) != ceil(endIndexVal) || startIndexVal < 0 ||
       endIndexVal < 0) {
-    runtimeError("Indices must be non-negative integers for 'substring'.");
+    vm.runtimeError("Indices must be non-negative integers for 'substring'.");
   }
-  if ((unsigned)startIndexVal >= strVal.size() ||
-      startIndexVal >= endIndexVal) {
-    return OBJECT_VAL(std::make_shared<ObjectString>(""));
-  } else if ((unsigned)endIndexVal >= strVal.size()) {
-    return OBJECT_VAL(
-        std::make_shared<ObjectString>(strVal.substr((unsigned)startIndexVal)));
-  } else {
-    double substrSize = endIndexVal - startIndexVal;
-    return OBJECT_VAL(std::make_shared<ObjectString>(
-        strVal.substr((unsigned)startIndexVal, (unsigned)substrSize)));
+  size_t length = source->getLength();
+  if (startIndexVal >= length || startIndexVal >= endIndexVal) {
+    return OBJECT_VAL(heap.intern(""));
   }
+  size_t end = endIndexVal >= length ? length : (size_t)endIndexVal;
+  return OBJECT_VAL(substringOf(source, (size_t)startIndexVal, end));
 }
 
-Value VM::sizeNative(int argCount, size_t start) {
-  if (argCount != 1) {
-    runtimeError("Expect 1 argument for 'size', but found %d.", argCount);
+double VM::lengthOf(Value value) {
+  if (IS_STRING(value)) {
+    return (double)AS_OBJECTSTRING(value)->getLength();
+  } else if (IS_LIST(value)) {
+    return (double)AS_OBJECTLIST(value)->size();
+  } else if (IS_MAP(value)) {
+    return (double)AS_OBJECTMAP(value)->size();
+  } else if (IS_PRIORITY_QUEUE(value)) {
+    return (double)AS_PRIORITY_QUEUE(value)->size();
+  } else if (IS_DEQUE(value)) {
+    return (double)AS_DEQUE(value)->size();
+  } else if (IS_STRING_BUILDER(value)) {
+    return (double)AS_STRING_BUILDER(value)->getLength();
   }
-  Value val = memory.getValueAt(start);
+  runtimeError("Invalid argument for 'size'.");
+  return 0;
+}
 
-  if (!IS_STRING(val) && !IS_LIST(val))
-    runtimeError("Invalid argument for 'size'.");
+Value VM::sizeNative(VM& vm, std::span<Value> args) {
+  return NUM_VAL(vm.lengthOf(args[0]));
+}
 
-  if (IS_STRING(val)) {
-    unsigned strSize = AS_STRING(val).size();
-    return NUM_VAL((double)strSize);
-  } else {
-    unsigned listSize = AS_OBJECTLIST(val)->size();
-    return NUM_VAL((double)listSize);
+Value VM::pushNative(VM& vm, std::span<Value> args) {
+  Value list = args[0];
+  if (IS_DEQUE(list)) {
+    AS_DEQUE(list)->pushBack(args[1]);
+    return list;
   }
+  if (!IS_LIST(list)) {
+    vm.runtimeError("Expect a list as first argument for 'push'.");
+  }
+  AS_OBJECTLIST(list)->add(args[1]);
+  return list;
 }
 
-std::shared_ptr<ObjectUpvalue> VM::captureUpvalue(Value* local,
-                                                  int localIndex) {
-  std::shared_ptr<ObjectUpvalue> prevUpvalue = nullptr;
-  std::shared_ptr<ObjectUpvalue> upvalue = openUpvalues;
+Value VM::popNative(VM& vm, std::span<Value> args) {
+  Value list = args[0];
+  if (IS_DEQUE(list)) {
+    if (AS_DEQUE(list)->size() == 0) {
+      vm.runtimeError("Cannot pop from an empty deque.");
+    }
+    return AS_DEQUE(list)->popBack();
+  }
+  if (!IS_LIST(list)) {
+    vm.runtimeError("Expect a list as argument for 'pop'.");
+  }
+  ObjectList* actualList = AS_OBJECTLIST(list);
+  if (actualList->size() == 0) {
+    vm.runtimeError("Cannot pop from an empty list.");
+  }
+  return actualList->removeAt(actualList->size() - 1);
+}
+
+Value VM::insertNative(VM& vm, std::span<Value> args) {
+  Value list = args[0];
+  if (!IS_LIST(list)) {
+    vm.runtimeError("Expect a list as first argument for 'insert'.");
+  }
+  ObjectList* actualList = AS_OBJECTLIST(list);
+  // inserting right after the last element is allowed
+  size_t index = vm.listIndex(args[1], actualList->size() + 1);
+  actualList->insert(args[2], index);
+  return list;
+}
+
+Value VM::removeAtNative(VM& vm, std::span<Value> args) {
+  Value list = args[0];
+  if (!IS_LIST(list)) {
+    vm.runtimeError("Expect a list as first argument for 'removeAt'.");
+  }
+  ObjectList* actualList = AS_OBJECTLIST(list);
+  size_t index = vm.listIndex(args[1], actualList->size());
+  return actualList->removeAt(index);
+}
+
+Value VM::keysNative(VM& vm, std::span<Value> args) {
+  Value map = args[0];
+  if (!IS_MAP(map)) {
+    vm.runtimeError("Expect a map as argument for 'keys'.");
+  }
+  std::vector<Value> keys;
+  keys.reserve(AS_OBJECTMAP(map)->size());
+  for (const ObjectMap::Entry& entry : AS_OBJECTMAP(map)->getEntries()) {
+    if (!IS_UNDEFINED(entry.key)) keys.push_back(entry.key);
+  }
+  return OBJECT_VAL(heap.allocate<ObjectList>(std::move(keys)));
+}
+
+Value VM::valuesNative(VM& vm, std::span<Value> args) {
+  Value map = args[0];
+  if (!IS_MAP(map)) {
+    vm.runtimeError("Expect a map as argument for 'values'.");
+  }
+  std::vector<Value> values;
+  values.reserve(AS_OBJECTMAP(map)->size());
+  for (const ObjectMap::Entry& entry : AS_OBJECTMAP(map)->getEntries()) {
+    if (!IS_UNDEFINED(entry.key)) values.push_back(entry.value);
+  }
+  return OBJECT_VAL(heap.allocate<ObjectList>(std::move(values)));
+}
+
+Value VM::hasKeyNative(VM& vm, std::span<Value> args) {
+  Value map = args[0];
+  if (!IS_MAP(map)) {
+    vm.runtimeError("Expect a map as first argument for 'hasKey'.");
+  }
+  return BOOL_VAL(AS_OBJECTMAP(map)->get(args[1]) != nullptr);
+}
+
+Value VM::removeNative(VM& vm, std::span<Value> args) {
+  Value map = args[0];
+  if (!IS_MAP(map)) {
+    vm.runtimeError("Expect a map as first argument for 'remove'.");
+  }
+  // returns the removed value, or null if the key wasn't there
+  Value removed = NULL_VAL;
+  AS_OBJECTMAP(map)->remove(args[1], &removed);
+  return removed;
+}
+
+Value VM::priorityQueueNative(VM&, std::span<Value>) {
+  return OBJECT_VAL(heap.allocate<ObjectPriorityQueue>());
+}
+
+Value VM::heapPushNative(VM& vm, std::span<Value> args) {
+  Value queue = args[0];
+  if (!IS_PRIORITY_QUEUE(queue)) {
+    vm.runtimeError(
+        "Expect a priority queue as first argument for 'heapPush'.");
+  }
+  Value key = args[1];
+  if (!IS_NUM(key) && !IS_STRING(key)) {
+    vm.runtimeError("Priority keys must be numbers or strings.");
+  }
+  ObjectPriorityQueue* actualQueue = AS_PRIORITY_QUEUE(queue);
+  // keys of different types can't be ordered against each other
+  if (actualQueue->size() != 0 &&
+      IS_NUM(key) != IS_NUM(actualQueue->getEntries().front().key)) {
+    vm.runtimeError("Priority keys must all be numbers or all be strings.");
+  }
+  actualQueue->push(key, args[2]);
+  return NULL_VAL;
+}
+
+Value VM::heapPopNative(VM& vm, std::span<Value> args) {
+  Value queue = args[0];
+  if (!IS_PRIORITY_QUEUE(queue)) {
+    vm.runtimeError("Expect a priority queue as argument for 'heapPop'.");
+  }
+  if (AS_PRIORITY_QUEUE(queue)->size() == 0) {
+    vm.runtimeError("Cannot perform operation on an empty heap.");
+  }
+  return AS_PRIORITY_QUEUE(queue)->pop();
+}
+
+Value VM::heapTopNative(VM& vm, std::span<Value> args) {
+  Value queue = args[0];
+  if (!IS_PRIORITY_QUEUE(queue)) {
+    vm.runtimeError("Expect a priority queue as argument for 'heapTop'.");
+  }
+  if (AS_PRIORITY_QUEUE(queue)->size() == 0) {
+    vm.runtimeError("Cannot perform operation on an empty heap.");
+  }
+  return AS_PRIORITY_QUEUE(queue)->top();
+}
+
+Value VM::dequeNative(VM&, std::span<Value>) {
+  return OBJECT_VAL(heap.allocate<ObjectDeque>());
+}
+
+Value VM::pushFrontNative(VM& vm, std::span<Value> args) {
+  Value deque = args[0];
+  if (!IS_DEQUE(deque)) {
+    vm.runtimeError("Expect a deque as first argument for 'pushFront'.");
+  }
+  AS_DEQUE(deque)->pushFront(args[1]);
+  return deque;
+}
+
+Value VM::popFrontNative(VM& vm, std::span<Value> args) {
+  Value deque = args[0];
+  if (!IS_DEQUE(deque)) {
+    vm.runtimeError("Expect a deque as argument for 'popFront'.");
+  }
+  if (AS_DEQUE(deque)->size() == 0) {
+    vm.runtimeError("Cannot pop from an empty deque.");
+  }
+  return AS_DEQUE(deque)->popFront();
+}
+
+ObjectUpvalue* VM::captureUpvalue(Value* local, int localIndex) {
+  ObjectUpvalue* prevUpvalue = nullptr;
+  ObjectUpvalue* upvalue = openUpvalues;
   while (upvalue != nullptr && upvalue->getLocationIndex() > localIndex) {
     prevUpvalue = upvalue;
     upvalue = upvalue->next;
@@ -866,8 +1500,7 @@ std::shared_ptr<ObjectUpvalue> VM::captureUpvalue(Value* local,
     return upvalue;
   }
 
-  std::shared_ptr<ObjectUpvalue> toReturn =
-      std::make_shared<ObjectUpvalue>(localIndex, local);
+  ObjectUpvalue* toReturn = heap.allocate<ObjectUpvalue>(localIndex, local);
   toReturn->next = upvalue;
 
   if (prevUpvalue == nullptr) {
@@ -882,50 +1515,65 @@ std::shared_ptr<ObjectUpvalue> VM::captureUpvalue(Value* local,
 void VM::closeUpvalues(int lastIndex) {
   while (openUpvalues != nullptr &&
          openUpvalues->getLocationIndex() >= lastIndex) {
-    std::shared_ptr<ObjectUpvalue> upvalue = openUpvalues;
+    ObjectUpvalue* upvalue = openUpvalues;
     upvalue->closed = *(upvalue->getLocation());
-    upvalue->location = &(upvalue->closed.value());
+    upvalue->location = &(upvalue->closed);
     openUpvalues = upvalue->next;
   }
 }
 
-void VM::defineField(std::shared_ptr<ObjectString> name) {
-  std::shared_ptr<ObjectClass> objClass = AS_CLASS(memory.top());
-  objClass->setField(name, (AccessModifier)readByte());
+void VM::defineField(ObjectString* name, AccessModifier accessModifier) {
+  ObjectClass* objClass = AS_CLASS(memory.top());
+  objClass->setField(name, accessModifier);
 }
 
-void VM::defineMethod(std::shared_ptr<ObjectString> name) {
+void VM::defineMethod(ObjectString* name, AccessModifier accessModifier) {
   Value method = memory.top();
-  std::shared_ptr<ObjectClass> classObj =
-      AS_CLASS(memory.getValueAt(memory.size() - 2));
-  classObj->setMethod(name, method, (AccessModifier)readByte());
+  ObjectClass* classObj = AS_CLASS(memory.getValueAt(memory.size() - 2));
+  classObj->setMethod(name, method, accessModifier);
   memory.pop();
 }
 
-bool VM::bindMethod(const ObjectClass& instanceOf,
-                    std::shared_ptr<ObjectString> name) {
+bool VM::bindMethod(const ObjectClass& instanceOf, ObjectString* name) {
   const Value* method = instanceOf.getMethod(name);
   if (method == nullptr) {
     runtimeError("Undefined property '%s'.", name->getString().c_str());
     return false;
   }
 
-  std::shared_ptr<ObjectBoundMethod> bound =
-      std::make_shared<ObjectBoundMethod>(memory.top(), AS_CLOSURE(*method));
+  ObjectBoundMethod* bound =
+      heap.allocate<ObjectBoundMethod>(memory.top(), AS_CLOSURE(*method));
   memory.pop();
   memory.push(OBJECT_VAL(bound));
   return true;
 }
 
-void VM::invoke(std::shared_ptr<ObjectString> name, int argCount) {
+void VM::invoke(ObjectString* name, ObjectString* className, int argCount,
+                InlineCache& cache) {
   Value receiver = memory.getValueAt(memory.size() - 1 - argCount);
 
   if (!IS_INSTANCE(receiver)) {
     runtimeError("Only instances have methods.");
   }
 
-  std::shared_ptr<ObjectInstance> instance = AS_INSTANCE(receiver);
-  validateAccessModifier(name, *instance);
+  ObjectInstance* instance = AS_INSTANCE(receiver);
+  const ObjectClass& instanceOf = instance->getInstanceOf();
+  const CacheEntry* entry = cache.find(&instanceOf, instanceOf.getVersion());
+  if (entry != nullptr) {
+    if (entry->method != nullptr) {
+      call(entry->method, argCount);
+      return;
+    }
+    const Value* field = instance->getFieldAt(entry->slot);
+    if (field != nullptr) {
+      memory.setValueAt(*field, memory.size() - 1 - argCount);
+      callValue(*field, argCount);
+      return;
+    }
+  }
+
+  validateAccessModifier(name, className, *instance);
+  cacheProperty(cache, instanceOf, name);
 
   const Value* field = instance->getField(name);
 
@@ -937,8 +1585,30 @@ void VM::invoke(std::shared_ptr<ObjectString> name, int argCount) {
   }
 }
 
-void VM::invokeFromClass(const ObjectClass& instanceOf,
-                         std::shared_ptr<ObjectString> name, int argCount) {
+void VM::cacheProperty(InlineCache& cache, const ObjectClass& instanceOf,
+                       ObjectString* name) {
+  // a field that an instance hasn't set yet misses every time, but the class
+  // already has its entry
+  if (cache.find(&instanceOf, instanceOf.getVersion()) != nullptr) return;
+
+  // Methods are only cached while no instance can shadow them with a field.
+  // Giving the name a slot changes the class's version.
+  int slot = instanceOf.getSlot(name);
+  if (slot != -1) {
+    cache.add(CacheEntry{&instanceOf, instanceOf.getVersion(), (size_t)slot,
+                         nullptr});
+    return;
+  }
+
+  const Value* method = instanceOf.getMethod(name);
+  if (method != nullptr) {
+    cache.add(CacheEntry{&instanceOf, instanceOf.getVersion(), 0,
+                         AS_CLOSURE(*method)});
+  }
+}
+
+void VM::invokeFromClass(const ObjectClass& instanceOf, ObjectString* name,
+                         int argCount) {
   const Value* method = instanceOf.getMethod(name);
 
   if (method == nullptr) {